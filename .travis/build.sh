@@ -8,7 +8,8 @@ if [ "$TRAVIS_OS_NAME" == "linux" ]; then
 		-DCMAKE_CXX_COMPILER=$CXX_COMPILER \
 		-DCMAKE_C_COMPILER=$C_COMPILER \
 		-GNinja -DCMAKE_CXX_FLAGS='--coverage' \
-		-DLLVM_CONFIG="/usr/lib/llvm-${LLVM_VERSION}/bin/llvm-config"
+		-DLLVM_CONFIG="/usr/lib/llvm-${LLVM_VERSION}/bin/llvm-config" \
+		-DCG_USE_LIBCLANG=${USE_LIBCLANG:-OFF}
 	
 	ninja
 	CTEST_OUTPUT_ON_FAILURE=1 ninja test
@@ -9,7 +9,7 @@ if [ "$TRAVIS_OS_NAME" == "linux" ]; then
 		libclang-common-${LLVM_VERSION}-dev ninja-build \
 		libedit-dev build-essential
 	
-	if [ "$LLVM_VERSION" == "3.9" ] || [ "$LLVM_VERSION" == "4.0" ]; then
+	if [ "$LLVM_VERSION" == "3.9" ] || [ "$LLVM_VERSION" == "4.0" ] || [ "$LLVM_VERSION" == "5.0" ]; then
 		sudo apt-get install liblldb-${LLVM_VERSION}-dev
 	else
 		sudo apt-get install lldb-${LLVM_VERSION}-dev
@@ -5,13 +5,16 @@
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 
+#include <chi/ClangFinder.hpp>
 #include <chi/Context.hpp>
 #include <chi/GraphFunction.hpp>
 #include <chi/GraphModule.hpp>
 #include <chi/LLVMVersion.hpp>
 #include <chi/LangModule.hpp>
 #include <chi/NodeType.hpp>
+#include <chi/Optimizer.hpp>
 #include <chi/Support/Result.hpp>
+#include <chi/Support/Subprocess.hpp>
 #include <chi/Support/json.hpp>
 
 #if LLVM_VERSION_LESS_EQUAL(3, 9)
@@ -25,16 +28,128 @@
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_os_ostream.h>
-#include <llvm/Transforms/IPO.h>
-#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
 
 using namespace chi;
 
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
 
+namespace {
+
+using toolOutput = llvm::
+#if LLVM_VERSION_LESS_EQUAL(5, 0)
+    tool_output_file
+#else
+    ToolOutputFile
+#endif
+    ;
+
+// Write `mod` to `outpath` as a native object file for the host. The code is always position
+// independent, so it can go in a shared library or a position independent executable
+Result emitObjectFile(llvm::Module& mod, llvm::CodeGenOpt::Level optLevel,
+                      const fs::path& outpath) {
+	Result res;
+
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+
+	auto        triple = llvm::sys::getProcessTriple();
+	std::string errMsg;
+	auto        target = llvm::TargetRegistry::lookupTarget(triple, errMsg);
+	if (target == nullptr) {
+		res.addEntry("EUKN", "Failed to find a target for the host",
+		             {{"Triple", triple}, {"Error", errMsg}});
+		return res;
+	}
+
+	std::unique_ptr<llvm::TargetMachine> tm{
+	    target->createTargetMachine(triple, llvm::sys::getHostCPUName(), "",
+	                                llvm::TargetOptions{}, llvm::Reloc::PIC_,
+	                                llvm::CodeModel::Default, optLevel)};
+	if (tm == nullptr) {
+		res.addEntry("EUKN", "Failed to create a TargetMachine for the host", {{"Triple", triple}});
+		return res;
+	}
+
+	mod.setTargetTriple(triple);
+#if LLVM_VERSION_AT_LEAST(3, 8)
+	mod.setDataLayout(tm->createDataLayout());
+#else
+	mod.setDataLayout(tm->getDataLayout());
+#endif
+
+	std::error_code ec;
+	std::string     errorString;  // only for LLVM 3.5-
+	auto            outFile = std::make_unique<toolOutput>
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	    (outpath.string().c_str(), errorString, llvm::sys::fs::F_None);
+#else
+	    (outpath.string(), ec, llvm::sys::fs::F_None);
+#endif
+	if (ec || !errorString.empty()) {
+		res.addEntry("EUKN", "Failed to open output file",
+		             {{"Path", outpath.string()},
+		              {"Error", ec ? ec.message() : errorString}});
+		return res;
+	}
+
+	llvm::legacy::PassManager passes;
+#if LLVM_VERSION_LESS_EQUAL(3, 6)
+	llvm::formatted_raw_ostream stream{outFile->os()};
+#else
+	auto& stream = outFile->os();
+#endif
+	if (tm->addPassesToEmitFile(passes, stream, llvm::TargetMachine::CGFT_ObjectFile)) {
+		res.addEntry("EUKN", "The host target can't emit object files", {{"Triple", triple}});
+		return res;
+	}
+	passes.run(mod);
+
+	outFile->keep();
+
+	return res;
+}
+
+// Link an object file into an executable or a shared library, using clang as the linker driver
+Result linkObjectFile(const fs::path& objectPath, const fs::path& outpath, bool shared) {
+	Result res;
+
+	auto clangExe = findClang();
+	if (clangExe.empty()) {
+		res.addEntry("EUKN", "Failed to find clang in path", nlohmann::json::object());
+		return res;
+	}
+
+	std::vector<std::string> arguments{objectPath.string(), "-o", outpath.string()};
+	if (shared) { arguments.emplace_back("-shared"); }
+
+	auto argumentsContext = res.addScopedContext({{"clang arguments", arguments}});
+
+	std::string errors;
+	Subprocess  linker{clangExe};
+	linker.setArguments(arguments);
+	linker.attachStringToStdErr(errors);
+
+	res += linker.start();
+	if (!res) { return res; }
+
+	if (linker.exitCode() != 0) {
+		res.addEntry("EUKN", "Failed to link with clang", {{"Error", errors}});
+	}
+
+	return res;
+}
+
+}  // anonymous namespace
+
 int compile(const std::vector<std::string>& opts) {
 	po::options_description compile_opts("chi compile");
 
@@ -44,8 +159,14 @@ int compile(const std::vector<std::string>& opts) {
 		("output,o", po::value<std::string>()->default_value("-"), "Output file, - for stdout (the default)")
 		(",c", "Output a binary file (llvm bitcode)")
 		(",S", "Output a textual file (llvm assembly)")
+		("emit", po::value<std::string>(), "What to output: bc, ll, obj (a native object file), exe or shared (a shared library)")
 		("no-dependencies,D", "Don't link the dependencies into the module")
 		("fresh,f", "Don't use the cache")
+		("parallel,p", "Generate dependencies in parallel")
+		("ssa", "Keep node outputs in registers instead of on the stack")
+		("fold-constants", "Compute constant expressions while compiling")
+		("inline", "Inline small functions into their callers")
+		("whole-program", "Only export the functions in the module itself from the linked module")
 		("machine-readable,m", "Create machine readable error messages (in JSON)")
 		("no-debug,n", "Strip debug information from the module")
 		("help,h", "Show this help page")
@@ -117,6 +238,11 @@ int compile(const std::vector<std::string>& opts) {
 	Flags<CompileSettings> settings;
 	if (vm.count("no-dependencies") == 0) { settings |= CompileSettings::LinkDependencies; }
 	if (vm.count("fresh") == 0) { settings |= CompileSettings::UseCache; }
+	if (vm.count("parallel") != 0) { settings |= CompileSettings::Parallel; }
+	if (vm.count("ssa") != 0) { settings |= CompileSettings::SSAOutputs; }
+	if (vm.count("fold-constants") != 0) { settings |= CompileSettings::FoldConstants; }
+	if (vm.count("inline") != 0) { settings |= CompileSettings::InlineFunctions; }
+	if (vm.count("whole-program") != 0) { settings |= CompileSettings::WholeProgram; }
 
 	std::unique_ptr<llvm::Module> llmod;
 	res += c.compileModule(*chiModule, settings, &llmod);
@@ -144,29 +270,12 @@ int compile(const std::vector<std::string>& opts) {
 		return 1;
 	}
 
-	llvm::PassManagerBuilder passBuilder;
-	passBuilder.OptLevel = levelInt;
-
-	// add inliner
-	if (levelInt > 1) {
-		passBuilder.Inliner = llvm::createFunctionInliningPass(levelInt, 1
-#if LLVM_VERSION_AT_LEAST(5, 0)
-		                                                       ,
-		                                                       false
-#endif
-		);
-	}
-
-	llvm::legacy::FunctionPassManager fpm{llmod.get()};
-	passBuilder.populateFunctionPassManager(fpm);
+	const llvm::CodeGenOpt::Level optLevels[] = {llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less,
+	                                             llvm::CodeGenOpt::Default,
+	                                             llvm::CodeGenOpt::Aggressive};
+	auto optLevel = optLevels[levelInt];
 
-	llvm::legacy::PassManager mpm;
-	passBuilder.populateModulePassManager(mpm);
-
-	// run function passes
-	for (auto& func : *llmod) { fpm.run(func); }
-
-	mpm.run(*llmod);
+	optimizeModule(*llmod, optLevel);
 
 	// get outpath
 	fs::path outpath = vm["output"].as<std::string>();
@@ -184,7 +293,7 @@ int compile(const std::vector<std::string>& opts) {
 	// then see if options were applied--these take precedence
 
 	// first make sure they weren't both specified
-	if (vm.count("-S") != 0 && vm.count("c") != 0) {
+	if (vm.count("-S") != 0 && vm.count("-c") != 0) {
 		std::cerr << "chi compile: cannot specify both -S and -c, please only specify one"
 		          << std::endl;
 		return 1;
@@ -193,18 +302,62 @@ int compile(const std::vector<std::string>& opts) {
 	if (vm.count("-S") != 0) { binaryOutput = false; }
 	if (vm.count("-c") != 0) { binaryOutput = true; }
 
+	if (vm.count("emit") != 0) {
+		if (vm.count("-S") != 0 || vm.count("-c") != 0) {
+			std::cerr << "chi compile: cannot specify --emit along with -S or -c" << std::endl;
+			return 1;
+		}
+
+		auto emit = vm["emit"].as<std::string>();
+		if (emit == "bc" || emit == "ll") {
+			binaryOutput = emit == "bc";
+		} else if (emit == "obj" || emit == "exe" || emit == "shared") {
+			if (emit != "obj" && outpath == "-") {
+				std::cerr << "chi compile: an output file is needed for --emit=" << emit
+				          << std::endl;
+				return 1;
+			}
+			// the runtime, which has the real main, is only linked into main modules
+			if (emit == "exe" && chiModule->shortName() != "main") {
+				std::cerr << "chi compile: only main modules can be compiled to executables"
+				          << std::endl;
+				return 1;
+			}
+
+			// executables and shared libraries are linked from a temporary object file
+			auto objectPath = emit == "obj"
+			                      ? outpath
+			                      : fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%.o");
+
+			res += emitObjectFile(*llmod, optLevel, objectPath);
+			if (res && emit != "obj") {
+				res += linkObjectFile(objectPath, outpath, emit == "shared");
+
+				boost::system::error_code removeEc;
+				fs::remove(objectPath, removeEc);
+			}
+
+			if (!res) {
+				if (vm.count("machine-readable") == 0) {
+					std::cerr << "chi compile: Failed to emit native code: " << std::endl
+					          << res << std::endl;
+				} else {
+					std::cerr << res.result_json.dump(2) << std::endl;
+				}
+				return 1;
+			}
+			return 0;
+		} else {
+			std::cerr << "chi compile: unrecognized --emit type: " << emit
+			          << ". Use bc, ll, obj, exe or shared" << std::endl;
+			return 1;
+		}
+	}
+
 	std::error_code          ec;
 	llvm::sys::fs::OpenFlags OpenFlags = llvm::sys::fs::F_None;
 	if (!binaryOutput) { OpenFlags |= llvm::sys::fs::F_Text; }
 
-	using toolOutput = llvm::
-#if LLVM_VERSION_LESS_EQUAL(5, 0)
-	    tool_output_file
-#else
-	    ToolOutputFile
-#endif
-	    ;
-
 	std::string errorString;  // only for LLVM 3.5-
 	auto        outFile = std::make_unique<toolOutput>
 #if LLVM_VERSION_LESS_EQUAL(3, 5)
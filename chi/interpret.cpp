@@ -1,5 +1,6 @@
 #include <chi/Context.hpp>
 #include <chi/LLVMVersion.hpp>
+#include <chi/Optimizer.hpp>
 #include <chi/Support/Result.hpp>
 
 #include <llvm/IR/Module.h>
@@ -31,6 +32,7 @@ int interpret(const std::vector<std::string>& opts, const char* argv0) {
 	    "Input file, - for stdin")("optimization,O", po::value<int>()->default_value(2),
 	                               "Optimization value, either 0, 1, 2, or 3")(
 	    "function,f", po::value<std::string>()->default_value("main"), "The function to run")(
+	    "lazy", "Compile each function when it's first called instead of all at once. LLVM 5.0+")(
 	    "subargs", po::value<std::vector<std::string>>(), "arguments for command");
 
 	po::positional_options_description pos;
@@ -111,6 +113,8 @@ int interpret(const std::vector<std::string>& opts, const char* argv0) {
 		mods.pop_front();
 	}
 
+	chi::optimizeModule(*realMod, optLevel);
+
 	// run it
 	llvm::Function* func = realMod->getFunction(vm["function"].as<std::string>());
 
@@ -123,7 +127,13 @@ int interpret(const std::vector<std::string>& opts, const char* argv0) {
 
 	int ret;
 
-	auto res = chi::interpretLLVMIRAsMain(std::move(realMod), optLevel, command_opts, func, &ret);
+	chi::Result res;
+	if (vm.count("lazy") != 0) {
+		res = chi::interpretLLVMIRAsMainLazily(std::move(realMod), optLevel, command_opts, func,
+		                                       &ret);
+	} else {
+		res = chi::interpretLLVMIRAsMain(std::move(realMod), optLevel, command_opts, func, &ret);
+	}
 	if (!res) {
 		std::cerr << "Faied to run module: " << std::endl << res << std::endl;
 		return 1;
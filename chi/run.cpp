@@ -5,8 +5,10 @@
 #include <chi/Context.hpp>
 #include <chi/GraphFunction.hpp>
 #include <chi/GraphModule.hpp>
+#include <chi/JITObjectCache.hpp>
 #include <chi/LangModule.hpp>
 #include <chi/NodeType.hpp>
+#include <chi/Optimizer.hpp>
 #include <chi/Support/Result.hpp>
 #include <chi/Support/json.hpp>
 
@@ -37,6 +39,8 @@ int run(const std::vector<std::string>& opts, const char* argv0) {
 	run_opts.add_options()
 		("input-file", po::value<std::string>(), "The input file, - for stdin. Should be a chi module")
 		("subargs", po::value<std::vector<std::string>>(), "Arguments to call main with")
+		("lazy", "Compile each function the first time it is called, instead of all at once. LLVM 5.0+")
+		("optimization,O", po::value<int>()->default_value(2), "The optimization level. Either 0, 1, 2, or 3")
 		;
 	// clang-format on
 
@@ -61,6 +65,19 @@ int run(const std::vector<std::string>& opts, const char* argv0) {
 
 	std::string infile = vm["input-file"].as<std::string>();
 
+	// get opt value
+	llvm::CodeGenOpt::Level optLevel;
+	switch (vm["optimization"].as<int>()) {
+	case 0: optLevel = llvm::CodeGenOpt::None; break;
+	case 1: optLevel = llvm::CodeGenOpt::Less; break;
+	case 2: optLevel = llvm::CodeGenOpt::Default; break;
+	case 3: optLevel = llvm::CodeGenOpt::Aggressive; break;
+	default:
+		std::cerr << "Unrecognized optimization level: " << vm["optimization"].as<int>()
+		          << std::endl;
+		return 1;
+	}
+
 	Context c{fs::current_path()};
 
 	// load module
@@ -107,8 +124,31 @@ int run(const std::vector<std::string>& opts, const char* argv0) {
 	// run it!
 
 	int ret;
-	res += interpretLLVMIRAsMain(std::move(llmod), llvm::CodeGenOpt::Default, command_opts, nullptr,
-	                             &ret);
+	if (vm.count("lazy") != 0) {
+		optimizeModule(*llmod, optLevel);
+
+		res += interpretLLVMIRAsMainLazily(std::move(llmod), optLevel, command_opts, nullptr,
+		                                   &ret);
+	} else {
+		// keep the native code next to the module cache, so an unchanged module starts right away
+		std::unique_ptr<JITObjectCache> objectCache;
+		if (c.hasWorkspace()) {
+			objectCache = std::make_unique<JITObjectCache>(c.workspacePath() / "lib" / ".objects",
+			                                               optLevel);
+		}
+
+		// key the object on the module before it's optimized, so when there's one already the
+		// optimizations don't have to run again
+		bool cached = false;
+		if (objectCache != nullptr) {
+			objectCache->setKey(*llmod, objectCache->cacheKeyForModule(*llmod));
+			cached = objectCache->hasObject(*llmod);
+		}
+		if (!cached) { optimizeModule(*llmod, optLevel); }
+
+		res += interpretLLVMIRAsMain(std::move(llmod), optLevel, command_opts, nullptr, &ret,
+		                             objectCache.get());
+	}
 	if (!res) {
 		std::cerr << res << std::endl;
 		return 1;
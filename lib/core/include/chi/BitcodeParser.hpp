@@ -17,6 +17,21 @@ Result parseBitcodeFile(const boost::filesystem::path& file, llvm::LLVMContext&
                         std::unique_ptr<llvm::Module>* toFill);
 Result parseBitcodeString(const std::string& bitcode, llvm::LLVMContext& ctx,
                           std::unique_ptr<llvm::Module>* toFill);
+
+/// Load a bitcode file lazily. The file is memory mapped if possible, and function bodies are only
+/// read when they are materialized, either by the linker, a JIT or materializeModule
+/// On LLVM 3.5 this is the same as parseBitcodeFile
+/// \param file The bitcode file
+/// \param ctx The context to load it into
+/// \param toFill The module to fill
+/// \return The Result
+Result parseBitcodeFileLazy(const boost::filesystem::path& file, llvm::LLVMContext& ctx,
+                            std::unique_ptr<llvm::Module>* toFill);
+
+/// Materialize every function in a lazily loaded module
+/// \param mod The module to materialize
+/// \return The Result
+Result materializeModule(llvm::Module& mod);
 }
 
 #endif  // CHI_BITCODE_PARSER_HPP
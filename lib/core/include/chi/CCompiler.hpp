@@ -8,9 +8,44 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/utility/string_view.hpp>
 
+#include <cstddef>
+#include <string>
+#include <vector>
+
 namespace chi {
 
+/// The number of bitcode files kept in a C bitcode cache directory, see compileCToLLVM. When one is
+/// stored and there are more than this, the least recently used ones are removed
+constexpr size_t maxCachedCBitcodeFiles = 64;
+
+/// Use clang to compile C source code to LLVM bitcode, without parsing it. It doesn't touch any
+/// LLVMContext, so it can be called from many threads at once.
+/// It also uses `stdCIncludePaths` to find basic include paths.
+/// \param[in] clangPath The path to the `clang` executable.
+/// \param[in] arguments The arguments to clang. Can include input files if desired.
+/// \param[in] inputCCode The C code to compile. If `arguments` contains input files, then this can
+/// be empty.
+/// \param[out] toFill The string to fill with the bitcode
+/// \param[in] cacheDir The directory to cache the bitcode in, see compileCToLLVM. Empty, the
+/// default, to always run clang.
+/// \param[in] headersDigest The hashCHeaders of the directories of the input files. When many
+/// files from the same directory are compiled, it's computed once instead of reading the whole
+/// directory again for every file's cache key. Empty, the default, to read them.
+/// \return The Result
+Result compileCToBitcode(const boost::filesystem::path& clangPath,
+                         std::vector<std::string> arguments, boost::string_view inputCCode,
+                         std::string* toFill, const boost::filesystem::path& cacheDir = {},
+                         boost::string_view headersDigest = {});
+
+/// Hash every file under a directory, for the headersDigest of compileCToBitcode
+/// \param[in] dir The directory
+/// \return The hash
+std::string hashCHeaders(const boost::filesystem::path& dir);
+
 /// Use clang to compile C source code to a llvm module
+/// When chigraph is built with `CG_USE_LIBCLANG`, the clang frontend is run in this process and
+/// generates the module straight into `llvmContext`, instead of running `clangPath` and parsing
+/// the bitcode it outputs. `clangPath` is still used to find clang's resource directory.
 /// It also uses `stdCIncludePaths` to find basic include paths.
 /// \param[in] clangPath The path to the `clang` executable.
 /// \param[in] llvmContext The LLVM context to create the module into
@@ -18,10 +53,16 @@ namespace chi {
 /// \param[in] inputCCode The C code to compile. If `arguments` contains input files, then this can
 /// be empty.
 /// \param[out] toFill The unique pointer module to create the module inside
+/// \param[in] cacheDir The directory to keep the generated bitcode in, so the same code isn't
+/// compiled twice. It's keyed by the code, the arguments, the contents of the input files and of
+/// the `-I` directories, the standard include paths and the clang executable, or the version of
+/// the linked clang library when compiling in process. Only the maxCachedCBitcodeFiles most
+/// recently used files are kept. Empty, the default, to always run clang.
 /// \return The Result
 Result compileCToLLVM(const boost::filesystem::path& clangPath, llvm::LLVMContext& llvmContext,
                       std::vector<std::string> arguments, boost::string_view inputCCode,
-                      std::unique_ptr<llvm::Module>* toFill);
+                      std::unique_ptr<llvm::Module>*  toFill,
+                      const boost::filesystem::path& cacheDir = {});
 
 }  // namespace chi
 
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "chi/CompileSettings.hpp"
 #include "chi/Fwd.hpp"
 #include "chi/Support/HashFilesystemPath.hpp"
 #include "chi/Support/json.hpp"
@@ -75,8 +76,17 @@ struct ChiModule {
 	/// Generate a llvm::Module from the module. Usually called by Context::compileModule
 	/// \param module The llvm::Module to fill into -- must be already filled with forward
 	/// declarations of dependencies
+	/// \param settings The settings it's being compiled with. Only the ones that change code
+	/// generation, like CompileSettings::SSAOutputs, matter here
 	/// \return The Result
-	virtual Result generateModule(llvm::Module& module) = 0;
+	virtual Result generateModule(llvm::Module& module, Flags<CompileSettings> settings) = 0;
+
+	/// Get a hash of everything that affects the code generated by generateModule, not counting
+	/// dependencies. Context::compileModule uses it to key the module cache.
+	/// The default hashes the full name and lastEditTime(), so modules that don't override this
+	/// are generated again whenever they are edited.
+	/// \return The hash, as a hex string
+	virtual std::string contentHash() const;
 
 	/// Get the dependencies
 	/// \return The dependencies
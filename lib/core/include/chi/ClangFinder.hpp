@@ -7,6 +7,10 @@
 #include <boost/filesystem/path.hpp>
 
 namespace chi {
+/// Find the clang executable. The `CHI_CLANG_EXECUTABLE` environment variable is used if it's
+/// set, and otherwise `clang-<LLVM version>` or `clang` is searched for next to the executable
+/// and in the path. Once clang is found, it isn't searched for again in this process.
+/// \return The path to clang, or an empty path if it wasn't found
 boost::filesystem::path findClang();
 }
 
@@ -0,0 +1,70 @@
+/// \file chi/CompileSettings.hpp
+/// Defines the CompileSettings enum
+
+#pragma once
+
+#ifndef CHI_COMPILE_SETTINGS_HPP
+#define CHI_COMPILE_SETTINGS_HPP
+
+#include "chi/Support/Flags.hpp"
+
+namespace chi {
+
+/// Settings for compiling modules
+enum class CompileSettings {
+
+	/// Use the cache in lib
+	UseCache = 1u,
+
+	/// Link in dependencies
+	/// If this is set, it will be a ready to run module
+	/// If not, it'll contain forward declarations for dependencies and full definitons
+	/// For functions in that module
+	/// Every module in the dependency tree is compiled and linked once, even if more than one
+	/// module depends on it. Circular dependencies are an error. Only the functions in dependencies
+	/// that can be called from the module's functions are generated, GraphModules that nothing
+	/// calls into aren't generated at all, and only the definitions that are actually used are
+	/// linked in.
+	LinkDependencies = 1u << 1,
+
+	/// Generate the module and its dependencies concurrently. Only has an effect with
+	/// LinkDependencies. Every GraphModule that isn't in the cache is generated on a worker thread
+	/// in its own Context (and `LLVMContext`), and the results are linked in dependency order so
+	/// the output doesn't depend on the scheduling
+	Parallel = 1u << 2,
+
+	/// Keep node outputs in SSA registers instead of on the stack. Each output is still given to
+	/// its NodeType as a pointer, but those that are only loaded and stored are promoted to
+	/// registers as soon as the function is generated, and they don't get debug info, so the IR is
+	/// small even without optimizations. The debugger can't read node outputs in modules compiled
+	/// with this.
+	SSAOutputs = 1u << 3,
+
+	/// Compute pure LangModule nodes whose inputs are all constant, like `lang:const-int` or
+	/// `lang:i32+i32` connected to constants, while compiling instead of generating code for them.
+	/// Like with SSAOutputs, the debugger can't read the outputs of the folded nodes.
+	FoldConstants = 1u << 4,
+
+	/// Inline calls to graph functions into their callers once everything is linked, even without
+	/// optimizations. Functions are inlined according to their InlinePolicy, which by default
+	/// inlines functions with at most smallFunctionNodeCount nodes that don't call other graph
+	/// functions. The exec input switches of the inlined calls are folded away too. Only has an
+	/// effect with LinkDependencies.
+	InlineFunctions = 1u << 5,
+
+	/// Compile the module as a whole program: once everything is linked, the graph functions in
+	/// dependencies get internal linkage and the fast calling convention, so the optimizer can
+	/// change their signatures and remove the ones that aren't used. Those whose data outputs are
+	/// all scalars return them along with the exec output in a struct, instead of storing them
+	/// through pointer arguments, and the output pointers of the rest are marked `noalias` and
+	/// `nocapture`. The functions in the module itself are the entry points and keep their
+	/// signatures. Only has an effect with LinkDependencies.
+	WholeProgram = 1u << 6,
+
+	/// Default, which is UseCache and LinkDependencies
+	Default = UseCache | LinkDependencies
+};
+
+}  // namespace chi
+
+#endif  // CHI_COMPILE_SETTINGS_HPP
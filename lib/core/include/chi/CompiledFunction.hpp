@@ -0,0 +1,123 @@
+/// \file chi/CompiledFunction.hpp
+/// Defines the CompiledFunction class
+
+#pragma once
+
+#ifndef CHI_COMPILED_FUNCTION_HPP
+#define CHI_COMPILED_FUNCTION_HPP
+
+#include "chi/Context.hpp"
+#include "chi/Fwd.hpp"
+#include "chi/Support/Flags.hpp"
+
+#include <llvm/Support/CodeGen.h>  // for CodeGenOpt
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+class ExecutionEngine;
+}
+
+namespace chi {
+
+/// A GraphFunction that has been compiled to native code, so it can be called from C++ as many
+/// times as needed without going through an `ExecutionEngine` each time.
+///
+/// The native function takes the index of the exec input to enter through as an `int32_t`, then
+/// each data input by value, then a pointer to each data output to fill, and it returns the index
+/// of the exec output that was taken. See GraphFunction::functionType. For example, a function with
+/// one exec input and output, two `lang:i32` inputs and one `lang:i32` output would be called like:
+///
+/// ```
+/// std::unique_ptr<chi::CompiledFunction> compiled;
+/// chi::Result res = chi::CompiledFunction::compile(*func, &compiled);
+///
+/// auto    add = compiled->as<int32_t(int32_t, int32_t, int32_t, int32_t*)>();
+/// int32_t sum;
+/// add(0, 1, 2, &sum);
+/// ```
+///
+/// It can also be run over many records at once with runBatch, which loops in native code instead
+/// of calling in from C++ for each record.
+struct CompiledFunction {
+	/// Compile a function, linking in everything it depends on, and run its module's static
+	/// constructors
+	/// \param[in] func The function to compile
+	/// \param[out] toFill The compiled function
+	/// \param[in] optLevel The optimization level. Above `CodeGenOpt::None`, the module is run
+	/// through LLVM's optimization pipeline as well
+	/// \param[in] settings The settings to compile the module with. LinkDependencies is always
+	/// added, as the native code can't have anything missing
+	/// \pre `toFill != nullptr`
+	/// \return The Result
+	static Result compile(GraphFunction& func, std::unique_ptr<CompiledFunction>* toFill,
+	                      llvm::CodeGenOpt::Level optLevel = llvm::CodeGenOpt::Default,
+	                      Flags<CompileSettings>  settings = CompileSettings::Default);
+
+	/// Destructor, runs the static destructors and frees the native code
+	~CompiledFunction();
+
+	CompiledFunction(const CompiledFunction&) = delete;
+	CompiledFunction(CompiledFunction&&)      = delete;
+
+	CompiledFunction& operator=(const CompiledFunction&) = delete;
+	CompiledFunction& operator=(CompiledFunction&&) = delete;
+
+	/// Get the address of the native function. It is valid as long as this object is
+	/// \return The address
+	void* address() const { return mAddress; }
+
+	/// Get the native function as a function pointer
+	/// \tparam Signature The signature of the function, which must match
+	/// GraphFunction::functionType
+	/// \return The function pointer
+	template <typename Signature>
+	Signature* as() const {
+		return reinterpret_cast<Signature*>(mAddress);
+	}
+
+	/// The signature of the batch driver. It calls the function `count` times, all entering through
+	/// `execInput`. `inputs` has a pointer to an array of `count` values for each data input, and
+	/// `outputs` has a pointer to an array of `count` values for each data output, which are
+	/// filled. The exec output taken for each record is stored in `execOutputs`, which also has
+	/// `count` elements.
+	using BatchSignature = void(int64_t count, int32_t execInput, void* const* inputs,
+	                            void* const* outputs, int32_t* execOutputs);
+
+	/// Get the address of the batch driver, which has the signature BatchSignature. It is compiled
+	/// along with the function, with the function inlined into it when optimizations are on, so
+	/// the loop over the records can be vectorized
+	/// \return The address
+	void* batchAddress() const { return mBatchAddress; }
+
+	/// Run the function over many records. See BatchSignature for details.
+	/// \param count The number of records
+	/// \param execInput The exec input to use for each record
+	/// \param inputs The input arrays, one for each data input
+	/// \param outputs The output arrays, one for each data output
+	/// \param execOutputs The array to store the exec output taken for each record
+	void runBatch(int64_t count, int32_t execInput, void* const* inputs, void* const* outputs,
+	              int32_t* execOutputs) const {
+		reinterpret_cast<BatchSignature*>(mBatchAddress)(count, execInput, inputs, outputs,
+		                                                 execOutputs);
+	}
+
+	/// Get the mangled name of the function, see mangleFunctionName
+	/// \return The name
+	const std::string& mangledName() const { return mMangledName; }
+
+private:
+	CompiledFunction(std::unique_ptr<llvm::ExecutionEngine> engine, void* address,
+	                 void* batchAddress, std::string mangledName);
+
+	std::unique_ptr<llvm::ExecutionEngine> mEngine;
+	void*                                  mAddress;
+	void*                                  mBatchAddress;
+	std::string                            mMangledName;
+};
+
+}  // namespace chi
+
+#endif  // CHI_COMPILED_FUNCTION_HPP
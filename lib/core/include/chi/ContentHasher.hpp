@@ -0,0 +1,44 @@
+/// \file chi/ContentHasher.hpp
+/// Defines the ContentHasher class
+
+#pragma once
+
+#ifndef CHI_CONTENT_HASHER_HPP
+#define CHI_CONTENT_HASHER_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include <llvm/Support/MD5.h>
+
+#include <string>
+
+namespace chi {
+
+/// Builds a stable hash from strings and files, for keying caches that live on disk.
+/// Every piece of data is hashed along with its length, so `add("ab"); add("c")` and
+/// `add("a"); add("bc")` give different hashes. It isn't a cryptographic hash.
+struct ContentHasher {
+	/// Add a string to the hash
+	/// \param data The data to add
+	void add(boost::string_view data);
+
+	/// Add the contents of a file to the hash. If it can't be read, just the path is added
+	/// \param file The file to add
+	void addFile(const boost::filesystem::path& file);
+
+	/// Add the version of LLVM and of chigraph's code generation, so caches keyed by this hash
+	/// aren't used by a compiler that would generate something different
+	void addCompilerVersion();
+
+	/// Get the hash. Nothing can be added after this is called.
+	/// \return The hash, in lowercase hex
+	std::string hash();
+
+private:
+	llvm::MD5 mMD5;
+};
+
+}  // namespace chi
+
+#endif  // CHI_CONTENT_HASHER_HPP
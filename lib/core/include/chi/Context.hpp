@@ -9,6 +9,7 @@
 #include <memory>
 #include <unordered_map>
 
+#include "chi/CompileSettings.hpp"
 #include "chi/Fwd.hpp"
 #include "chi/ModuleCache.hpp"
 #include "chi/Support/Flags.hpp"
@@ -22,22 +23,6 @@
 
 namespace chi {
 
-/// Settings for compiling modules
-enum class CompileSettings {
-
-	/// Use the cache in lib
-	UseCache = 1u,
-
-	/// Link in dependencies
-	/// If this is set, it will be a ready to run module
-	/// If not, it'll contain forward declarations for dependencies and full definitons
-	/// For functions in that module
-	LinkDependencies = 1u << 1,
-
-	/// Default, which is both
-	Default = UseCache | LinkDependencies
-};
-
 /// The class that handles the loading, creation, storing, and compilation of modules
 /// It also stores a \c LLVMContext object to be used everywhere.
 ///
@@ -199,15 +184,18 @@ struct Context {
 	void setModuleCache(std::unique_ptr<ModuleCache> newCache);
 
 private:
+	// Link a copy of runtime.bc into `into`, finding and parsing it the first time
+	Result linkRuntime(llvm::Module& into);
+
 	boost::filesystem::path mWorkspacePath;
 
 	llvm::LLVMContext mLLVMContext;
 
-	std::vector<std::unique_ptr<ChiModule>> mModules;
+	// the parsed runtime.bc, kept so main modules don't parse it every time. After mLLVMContext so
+	// it's destroyed first
+	std::unique_ptr<llvm::Module> mRuntimeModule;
 
-	// This cache is only for use during compilation to not duplicate modules
-	std::unordered_map<std::string /*full name*/, llvm::Module* /*the compiled module*/>
-	    mCompileCache;
+	std::vector<std::unique_ptr<ChiModule>> mModules;
 
 	LangModule* mLangModule = nullptr;
 
@@ -235,11 +223,14 @@ std::string stringifyLLVMType(llvm::Type* ty);
 /// \param[in] args The arguments to pass to the function, empty by default
 /// \param[in] funcToRun The function to run. By default it uses "main".
 /// \param[out] ret The `GenericValue` to fill with the result of the function. Optional
+/// \param[in] objectCache The cache to get native code from and store it in, for example a
+/// JITObjectCache. Optional
 /// \return The Result
 Result interpretLLVMIR(std::unique_ptr<llvm::Module>          mod,
                        llvm::CodeGenOpt::Level                optLevel = llvm::CodeGenOpt::Default,
                        const std::vector<llvm::GenericValue>& args     = {},
-                       llvm::Function* funcToRun = nullptr, llvm::GenericValue* ret = nullptr);
+                       llvm::Function* funcToRun = nullptr, llvm::GenericValue* ret = nullptr,
+                       llvm::ObjectCache* objectCache = nullptr);
 
 /// Interpret LLVM IR as if it were the main function
 /// \param[in] mod The module to interpret
@@ -247,11 +238,28 @@ Result interpretLLVMIR(std::unique_ptr<llvm::Module>          mod,
 /// \param[in] args The arguments to main
 /// \param[in] funcToRun The function, defaults to "main" from `mod`
 /// \param[out] ret The return from main. Optional.
+/// \param[in] objectCache The cache to get native code from and store it in, for example a
+/// JITObjectCache. Optional
 /// \return The Result
 Result interpretLLVMIRAsMain(std::unique_ptr<llvm::Module>   mod,
                              llvm::CodeGenOpt::Level         optLevel = llvm::CodeGenOpt::Default,
                              const std::vector<std::string>& args     = {},
-                             llvm::Function* funcToRun = nullptr, int* ret = nullptr);
+                             llvm::Function* funcToRun = nullptr, int* ret = nullptr,
+                             llvm::ObjectCache* objectCache = nullptr);
+
+/// Interpret LLVM IR as if it were the main function, but only compile each function the first
+/// time it's called, so code that never runs is never compiled. This uses LLVM's ORC JIT, so on
+/// LLVM versions older than 5.0 it fails without running anything
+/// \param[in] mod The module to interpret
+/// \param[in] optLevel The optimization level
+/// \param[in] args The arguments to main
+/// \param[in] funcToRun The function, defaults to "main" from `mod`
+/// \param[out] ret The return from main. Optional.
+/// \return The Result
+Result interpretLLVMIRAsMainLazily(
+    std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt::Level optLevel = llvm::CodeGenOpt::Default,
+    const std::vector<std::string>& args = {}, llvm::Function* funcToRun = nullptr,
+    int* ret = nullptr);
 }  // namespace chi
 
 #endif  // CHI_CONTEXT_HPP
@@ -7,29 +7,46 @@
 
 namespace chi {
 
+/// The ModuleCache used by default, which stores bitcode files in the lib directory of the
+/// workspace. A few versions of each module are kept, so switching back and forth between
+/// branches doesn't mean compiling everything again.
 struct DefaultModuleCache : public ModuleCache {
 	/// Default constrcutor
 	/// \param ctx The context to cache for
 	DefaultModuleCache(Context& ctx);
 
-	/// Get the cache name for a module. Basically `context().workspacePath() / moduleName + ".bc"`
+	/// The number of versions of a module that are kept. When a module is cached and there
+	/// are more than this, the least recently used ones are deleted
+	static constexpr size_t maxVersionsPerModule = 8;
+
+	/// Get the directory the versions of a module are cached in. Basically
+	/// `context().workspacePath() / "lib" / moduleName`
+	/// \param moduleName The name of the module
+	/// \return The path
+	boost::filesystem::path cacheDirForModule(const boost::filesystem::path& moduleName) const;
+
+	/// Get the cache path for a version of a module. Basically
+	/// `cacheDirForModule(moduleName) / (cacheKey + ".bc")`
 	/// \param moduleName The name of the module to get a cache path for
+	/// \param cacheKey The key of the version
 	/// \return The path
-	boost::filesystem::path cachePathForModule(const boost::filesystem::path& moduleName) const;
+	boost::filesystem::path cachePathForModule(const boost::filesystem::path& moduleName,
+	                                           boost::string_view             cacheKey) const;
 
 	/// \copydoc ModuleCache::cacheModule
 	Result cacheModule(const boost::filesystem::path& moduleName, llvm::Module& compiledModule,
-	                   std::time_t timeAtFileRead) override;
+	                   boost::string_view cacheKey) override;
 
 	/// \copydoc ModuleCache::invalidateModule
 	void invalidateCache(const boost::filesystem::path& moduleName) override;
 
-	/// \copydoc ModuleCache::cacheUpdateTime
-	std::time_t cacheUpdateTime(const boost::filesystem::path& moduleName) const override;
-
 	/// \copydoc ModuleCache::retrieveFromCache
 	std::unique_ptr<llvm::Module> retrieveFromCache(const boost::filesystem::path& moduleName,
-	                                                std::time_t atLeastThisNew) override;
+	                                                boost::string_view cacheKey) override;
+
+private:
+	// remove `lib/<moduleName>.bc`, where modules were cached before there were versions of them
+	void removeUnversionedCache(const boost::filesystem::path& moduleName) const;
 };
 }
 
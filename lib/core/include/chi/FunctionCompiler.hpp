@@ -6,6 +6,7 @@
 #ifndef CHI_FUNCTION_COMPILER_HPP
 #define CHI_FUNCTION_COMPILER_HPP
 
+#include "chi/CompileSettings.hpp"
 #include "chi/Fwd.hpp"
 #include "chi/LLVMVersion.hpp"
 #include "chi/NodeCompiler.hpp"
@@ -14,6 +15,7 @@
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/bimap.hpp>
 #include <boost/utility/string_view.hpp>
@@ -27,8 +29,10 @@ struct FunctionCompiler {
 	/// \param moduleToGenInto The module to create the function in
 	/// \param debugCU The compile unit we're in
 	/// \param debugBuilder The Debug information builder for the module
+	/// \param settings The settings that change code generation. See CompileSettings
 	FunctionCompiler(const GraphFunction& func, llvm::Module& moduleToGenInto,
-	                 llvm::DICompileUnit& debugCU, llvm::DIBuilder& debugBuilder);
+	                 llvm::DICompileUnit& debugCU, llvm::DIBuilder& debugBuilder,
+	                 Flags<CompileSettings> settings = {});
 
 	/// Creates the function, but don't actually generate into it
 	/// \pre `initialized() == false`
@@ -111,14 +115,14 @@ struct FunctionCompiler {
 		return *mLLFunction;
 	}
 
-	/// Get the value for the address to jump back to
-	/// \pre `initialized() == true`
-	/// \return The value
-	llvm::Value& postPureBreak() const {
-		assert(initialized() &&
-		       "Please initialize the function compiler before trying to get the post-pure break");
-		return *mPostPureBreak;
-	}
+	/// Get the settings the function is being compiled with
+	/// \return The settings
+	Flags<CompileSettings> settings() const { return mSettings; }
+
+	/// Keep an alloca in a register if possible, once the function is generated. Only done with
+	/// CompileSettings::SSAOutputs
+	/// \param alloca The alloca to promote
+	void promoteToRegister(llvm::AllocaInst& alloca) { mAllocasToPromote.push_back(&alloca); }
 
 	/// Get the graph function
 	/// \retrun The GraphFunction
@@ -157,6 +161,12 @@ struct FunctionCompiler {
 	/// \return The compiler.
 	NodeCompiler* getOrCreateNodeCompiler(NodeInstance& node);
 
+	/// Get the pures a node depends on, in order of dependency. It's only computed once for each
+	/// node, see dependentPuresRecursive
+	/// \pre `&node.function() == &function()`
+	/// \return The dependent pures
+	const std::vector<NodeInstance*>& dependentPures(NodeInstance& node);
+
 private:
 	std::unordered_map<std::string, llvm::Value*> mLocalVariables;
 
@@ -173,12 +183,16 @@ private:
 
 	std::unordered_map<NodeInstance*, NodeCompiler> mNodeCompilers;
 
+	std::unordered_map<NodeInstance*, std::vector<NodeInstance*>> mDependentPures;
+
 	boost::bimap<unsigned, NodeInstance*> mNodeLocations;
 
 	bool mInitialized = false;
 	bool mCompiled    = false;
 
-	llvm::Value* mPostPureBreak = nullptr;
+	Flags<CompileSettings> mSettings;
+
+	std::vector<llvm::AllocaInst*> mAllocasToPromote;
 };
 
 /// Compile the graph to an \c llvm::Function (usually called from JsonModule::generateModule)
@@ -186,9 +200,10 @@ private:
 /// \param mod The module to codgen into, should already be a valid module
 /// \param debugCU The compilation unit that the GraphFunction resides in.
 /// \param debugBuilder The debug builder to build debug info
+/// \param settings The settings that change code generation. See CompileSettings
 /// \return The result
 Result compileFunction(const GraphFunction& func, llvm::Module* mod, llvm::DICompileUnit* debugCU,
-                       llvm::DIBuilder& debugBuilder);
+                       llvm::DIBuilder& debugBuilder, Flags<CompileSettings> settings = {});
 }  // namespace chi
 
 #endif  // CHI_FUNCTION_COMPILER_HPP
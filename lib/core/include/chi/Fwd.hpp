@@ -37,10 +37,12 @@ class DISubprogram;
 class Function;
 class FunctionType;
 class BasicBlock;
-class IndirectBrInst;
 class DebugLoc;
 class Value;
 struct GenericValue;
+class ObjectCache;
+class AllocaInst;
+class Constant;
 }
 
 #endif  // CHI_FWD_HPP
@@ -18,6 +18,21 @@
 #include <boost/uuid/uuid.hpp>
 
 namespace chi {
+
+/// If calls to a GraphFunction should be inlined into its callers
+enum class InlinePolicy {
+	/// Inline it if it's small and doesn't call other graph functions, see smallFunctionNodeCount
+	Auto,
+	/// Always inline it
+	Always,
+	/// Never inline it
+	Never,
+};
+
+/// Functions with at most this many nodes that don't call other graph functions are inlined with
+/// CompileSettings::InlineFunctions, unless their InlinePolicy says otherwise
+constexpr size_t smallFunctionNodeCount = 16;
+
 /// this is an AST-like representation of a function in a graph
 /// It is used for IDE-like behavior, codegen, and JSON generation.
 struct GraphFunction {
@@ -302,6 +317,14 @@ struct GraphFunction {
 	/// \return The description
 	const std::string& description() const { return mDescription; };
 
+	/// Set if calls to the function should be inlined
+	/// \param newPolicy The new policy
+	void setInlinePolicy(InlinePolicy newPolicy) { mInlinePolicy = newPolicy; }
+
+	/// Get if calls to the function should be inlined
+	/// \return The policy
+	InlinePolicy inlinePolicy() const { return mInlinePolicy; }
+
 	// Various getters
 	//////////////////
 
@@ -335,6 +358,7 @@ private:
 	Context*     mContext;
 	std::string  mName;  /// the name of the function
 	std::string  mDescription;
+	InlinePolicy mInlinePolicy = InlinePolicy::Auto;
 
 	std::vector<NamedDataType> mDataInputs;
 	std::vector<NamedDataType> mDataOutputs;
@@ -11,6 +11,9 @@
 
 #include <boost/bimap.hpp>
 
+#include <string>
+#include <unordered_set>
+
 namespace chi {
 /// Module that holds graph functions
 struct GraphModule : public ChiModule {
@@ -40,7 +43,20 @@ struct GraphModule : public ChiModule {
 
 	Result addForwardDeclarations(llvm::Module& module) const override;
 
-	Result generateModule(llvm::Module& module) override;
+	Result generateModule(llvm::Module& module, Flags<CompileSettings> settings) override;
+
+	/// Generate only some of the functions in the module. The others are only declared. The C
+	/// sources are compiled either way.
+	/// \param module The module to generate into
+	/// \param settings The settings, see ChiModule::generateModule
+	/// \param functions The names of the functions to generate
+	/// \return The Result
+	Result generateModule(llvm::Module& module, Flags<CompileSettings> settings,
+	                      const std::unordered_set<std::string>& functions);
+
+	/// Hashes the serialized module and, if C support is enabled, everything in the .c directory
+	/// \return The hash
+	std::string contentHash() const override;
 
 	/////////////////////
 
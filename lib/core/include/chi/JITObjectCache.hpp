@@ -0,0 +1,91 @@
+/// \file chi/JITObjectCache.hpp
+/// Defines the JITObjectCache class
+
+#pragma once
+
+#ifndef CHI_JIT_OBJECT_CACHE_HPP
+#define CHI_JIT_OBJECT_CACHE_HPP
+
+#include "chi/LLVMVersion.hpp"
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/CodeGen.h>  // for CodeGenOpt
+
+#include <boost/filesystem/path.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace chi {
+
+/// An `llvm::ObjectCache` that stores the native objects MCJIT generates on disk, so running an
+/// unchanged module again loads the object instead of doing code generation.
+/// Objects are keyed by a hash of the module's bitcode, the optimization level, the host and the
+/// compiler version. The key is computed from the module every time it's needed, unless one was
+/// given with setKey. Only a few objects are kept, least recently used ones are removed.
+struct JITObjectCache : llvm::ObjectCache {
+	/// Constructor
+	/// \param cacheDir The directory to store objects in. It's created when the first object is
+	/// stored
+	/// \param optLevel The optimization level the `ExecutionEngine` using this cache has
+	JITObjectCache(boost::filesystem::path cacheDir,
+	               llvm::CodeGenOpt::Level optLevel = llvm::CodeGenOpt::Default);
+
+	/// The number of objects that are kept
+	static constexpr size_t maxCachedObjects = 32;
+
+	/// Get the directory objects are stored in
+	/// \return The directory
+	const boost::filesystem::path& cacheDir() const { return mCacheDir; }
+
+	/// Compute the key of the object for a module from its current contents
+	/// \param mod The module
+	/// \return The key
+	std::string cacheKeyForModule(const llvm::Module& mod) const;
+
+	/// Use `key` for the object of `mod` instead of computing it from the module. This way a module
+	/// can be keyed before it's optimized. The key is forgotten once the object is loaded or stored
+	/// \param mod The module
+	/// \param key The key, from cacheKeyForModule
+	void setKey(const llvm::Module& mod, std::string key);
+
+	/// Get the path that the object for a module is stored at
+	/// \param mod The module
+	/// \return The path, which may not exist
+	boost::filesystem::path cachePathForModule(const llvm::Module& mod) const;
+
+	/// Check if there is an object for a module, without reading it
+	/// \param mod The module
+	/// \return If there is one
+	bool hasObject(const llvm::Module& mod) const;
+
+	/// Store an object that was just compiled
+	/// \param mod The module that was compiled
+	/// \param obj The object
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	void notifyObjectCompiled(const llvm::Module* mod, const llvm::MemoryBuffer* obj) override;
+#else
+	void notifyObjectCompiled(const llvm::Module* mod, llvm::MemoryBufferRef obj) override;
+#endif
+
+	/// Get the object for a module if it has been compiled before
+	/// \param mod The module
+	/// \return The object, or nullptr if it isn't cached
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	llvm::MemoryBuffer* getObject(const llvm::Module* mod) override;
+#else
+	std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* mod) override;
+#endif
+
+private:
+	boost::filesystem::path mCacheDir;
+	llvm::CodeGenOpt::Level mOptLevel;
+
+	// the keys given with setKey, only until the module is loaded or stored
+	std::unordered_map<const llvm::Module*, std::string> mExplicitKeys;
+};
+
+}  // namespace chi
+
+#endif  // CHI_JIT_OBJECT_CACHE_HPP
@@ -42,7 +42,7 @@ struct LangModule : ChiModule {
 
 	Result addForwardDeclarations(llvm::Module& module) const override;
 
-	Result generateModule(llvm::Module& /*module*/) override;
+	Result generateModule(llvm::Module& /*module*/, Flags<CompileSettings> /*settings*/) override;
 
 private:
 	std::unordered_map<std::string,
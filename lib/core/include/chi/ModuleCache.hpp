@@ -8,7 +8,7 @@
 #include <chi/Fwd.hpp>
 
 #include <boost/filesystem/path.hpp>
-#include <ctime>
+#include <boost/utility/string_view.hpp>
 
 namespace chi {
 
@@ -30,29 +30,25 @@ struct ModuleCache {
 	/// \param moduleName The name of the module to cache
 	/// \pre `!moduleName.empty()`
 	/// \param compiledModule The IR that's been compiled from this module
-	/// \param timeAtFileRead The time to store as the cache time. Should be the time the module was
-	/// read from disk
+	/// \param cacheKey The key to store it under. This is a hash of everything that went into
+	/// compiling it: the module itself, its dependencies and the compiler version
 	/// \return The Result
 	virtual Result cacheModule(const boost::filesystem::path& moduleName,
-	                           llvm::Module& compiledModule, std::time_t timeAtFileRead) = 0;
+	                           llvm::Module& compiledModule, boost::string_view cacheKey) = 0;
 
-	/// Inavlidate the cache, ie. delete the cache file
+	/// Inavlidate the cache, ie. delete all the cache files for a module
 	/// \param moduleName The name of the module to invalidate
 	/// \pre `!moduleName.empty()`
 	virtual void invalidateCache(const boost::filesystem::path& moduleName) = 0;
 
-	/// Get the time that a cache was updated
-	/// \param moduleName The module to get the last update time for
-	/// \return The time it was updated, or 0 if there is no cache
-	virtual std::time_t cacheUpdateTime(const boost::filesystem::path& moduleName) const = 0;
-
 	/// Retrieve a module from the cache
 	/// \param moduleName The name of the module to retrieve
 	/// \pre `!moduleName.empty()`
-	/// \param atLeastThisNew Make sure the cache is at least as new as this
-	/// \return A llvm::Module, or nullptr if no suitable cache was found
+	/// \param cacheKey The key it was cached with. See cacheModule
+	/// \return A llvm::Module, or nullptr if no suitable cache was found. It may be lazily loaded,
+	/// so use materializeModule before touching function bodies
 	virtual std::unique_ptr<llvm::Module> retrieveFromCache(
-	    const boost::filesystem::path& moduleName, std::time_t atLeastThisNew) = 0;
+	    const boost::filesystem::path& moduleName, boost::string_view cacheKey) = 0;
 
 	/// Get the context this cache is bound to
 	/// \return the `Context`
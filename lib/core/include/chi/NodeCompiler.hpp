@@ -7,7 +7,6 @@
 
 #include "chi/Fwd.hpp"
 
-#include <cassert>
 #include <unordered_set>
 #include <vector>
 
@@ -19,8 +18,12 @@ namespace chi {
 ///
 /// Nodes are compiled using many `BasicBlock`s
 /// The first are for the dependent pures, one for each.
-/// The idea is that you point the last pure to jump to the next pure,
+/// The code for each pure is generated right in its block, which then jumps to the next pure,
 /// and when you get to the last pure, then go to the actual block for this node.
+/// Pure nodes don't have blocks of their own, they're generated again for each node that uses them,
+/// so the function only has direct branches. Pures that were already computed by the node that
+/// always runs right before this one, and that it didn't invalidate, are reused instead (see
+/// availablePures).
 struct NodeCompiler {
 	/// Constructor
 	/// \param functionCompiler The function compiler instance
@@ -49,23 +52,52 @@ struct NodeCompiler {
 	/// \return `node().type().pure()`
 	bool pure() const;
 
-	/// Add the basic blocks and fill the pure blocks, but don't fill the code block
+	/// Add the basic blocks for the node and its dependent pures, but don't fill them
 	/// nop if its already been called with this inputExecID
 	/// \param inputExecID The input exec to compile
+	/// \pre `!pure()`
 	/// \pre `inputExecID < inputExecs()`
 	void compile_stage1(size_t inputExecID);
 
-	/// Fill the codegen block
+	/// Fill the pure blocks and the codegen block
 	/// If compile_stage1 hasn't been called for this inputExecID, then it will be called
 	/// nop if this inputExecID has been compiled before
 	/// \param trailingBlocks The basic blocks to br to when the node is done, one for each exec
 	/// output
-	/// \pre `pure() || (trailingBlock.size() == node().outputExecConnections.size())`
-	/// Either it's pure (in which case `trailingBlock` is ignored) or it must be defined
+	/// \pre `!pure()`
+	/// \pre `trailingBlock.size() == node().outputExecConnections.size()`
 	/// \param inputExecID The input exec ID to compile
 	/// \pre `inputExecID < inputExecs()`
 	Result compile_stage2(std::vector<llvm::BasicBlock*> trailingBlocks, size_t inputExecID);
 
+	/// Generate the code for a pure node into a block of a node that uses it. This is done once
+	/// for every use, so the values are computed where they're needed
+	/// \param block The block to generate the code into
+	/// \param nextBlock The block to br to once the outputs are computed
+	/// \pre `pure()`
+	/// \return The Result
+	Result compilePureInto(llvm::BasicBlock& block, llvm::BasicBlock& nextBlock);
+
+	/// Get the pures whose outputs are still valid when this node starts running through an input
+	/// exec, so they don't need to be computed again. When the input exec only has one node
+	/// connected to it, and that node only has one input exec, it's every pure that node
+	/// depended on or had available, except for those that read the outputs of that node or the
+	/// local variable it sets. Otherwise it's empty.
+	/// \param inputExecID The input exec
+	/// \pre `!pure()`
+	/// \pre `inputExecID < inputExecs()`
+	/// \return The available pures
+	const std::unordered_set<NodeInstance*>& availablePures(size_t inputExecID);
+
+	/// Get the outputs of the node if it could be computed while compiling. That's done with
+	/// CompileSettings::FoldConstants for pure LangModule nodes (constants, arithmetic,
+	/// comparisons and conversions) whose inputs are all folded too. Those nodes don't generate any
+	/// code, and nodes that use them get the constants directly instead of loading them. Nodes that
+	/// would trap, like dividing by zero, aren't folded and still load their inputs, so the
+	/// division is left for runtime.
+	/// \return The constant for each output, or an empty vector if it can't be folded
+	const std::vector<llvm::Constant*>& constantOutputs();
+
 	/// Get if compile_stage2 has been called for a given inputExecID
 	/// \param inputExecID the ID to check
 	/// \pre `inputExecID < inputExecs()`
@@ -104,37 +136,44 @@ struct NodeCompiler {
 	/// \return a vector of the return values
 	std::vector<llvm::Value*> returnValues() const { return mReturnValues; }
 
-	/// Get the IndirectBrInst* for the pure
-	/// \pre `pure()`
-	/// \return The indirectbr instance
-	llvm::IndirectBrInst& jumpBackInst() const {
-		assert(pure() && "Cannot get jump back inst for a nonpure node");
-		return *mJumpBackInst;
-	}
-
 private:
+	// the pures that are still valid once this node has run through `inputExecID`
+	std::unordered_set<NodeInstance*> puresAfter(size_t inputExecID);
+
+	// load the inputs and run the NodeType's codegen into `block`
+	Result codegenInto(llvm::BasicBlock& block, size_t inputExecID,
+	                   std::vector<llvm::BasicBlock*> trailingBlocks);
+
 	FunctionCompiler* mCompiler;
 	NodeInstance*     mNode;
 
 	std::vector<std::vector<llvm::BasicBlock*>> mPureBlocks;
+	std::vector<std::vector<NodeInstance*>>     mPureNodes;
 	std::vector<llvm::BasicBlock*>              mCodeBlocks;
 
 	std::vector<llvm::Value*> mReturnValues;
 
 	boost::dynamic_bitset<> mCompiledInputs;
 
-	llvm::IndirectBrInst* mJumpBackInst = nullptr;
+	std::vector<std::unordered_set<NodeInstance*>> mAvailablePures;
+	boost::dynamic_bitset<>                        mFoundAvailablePures;
+
+	std::vector<llvm::Constant*> mConstantOutputs;
+	bool                         mTriedFolding = false;
+	// if folding was refused because the node would trap at runtime, like dividing by zero
+	bool mFoldingTraps = false;
 };
 
 /// Get the pures a NodeInstance relies on
-/// These are all the dependent pures (it's fetched recursively)
+/// These are all the dependent pures (it's fetched recursively), each one only once
 /// They are in the order of dependency, for examply if node X depends on node Y, then node Y will
 /// come before node X
-/// \warning Recursive based on how many pures are in a chain. Cyclic pure dependencies will crash.
-/// TODO: make sure they don't crash, and issue a nice error
+/// This is linear in the number of pures and connections between them. Cyclic pure dependencies
+/// don't crash, but the order is meaningless for them (they fail validation anyways)
 /// \param inst The NodeInstance to get the dependent pures for
 /// \return All the directly dependent pures
 /// \post all the elements in the return are pure
+/// \post there are no duplicates in the return
 std::vector<NodeInstance*> dependentPuresRecursive(const NodeInstance& inst);
 
 }  // namespace chi
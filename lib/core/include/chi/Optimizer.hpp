@@ -0,0 +1,25 @@
+/// \file chi/Optimizer.hpp
+/// Defines optimizeModule, the optimization pipeline shared by everything that compiles modules
+
+#pragma once
+
+#ifndef CHI_OPTIMIZER_HPP
+#define CHI_OPTIMIZER_HPP
+
+#include "chi/Fwd.hpp"
+
+#include <llvm/Support/CodeGen.h>  // for CodeGenOpt
+
+namespace chi {
+
+/// Run LLVM's standard optimization pipeline for `optLevel` over a module, like clang does for the
+/// same `-O` level. At `CodeGenOpt::Default` and above this includes the inliner and the loop and
+/// SLP vectorizers. On LLVM 4.0 and newer it uses the new pass manager, and on older versions the
+/// legacy one.
+/// \param mod The module to optimize, which should be fully linked so calls can be inlined
+/// \param optLevel The optimization level. Nothing is done for `CodeGenOpt::None`
+void optimizeModule(llvm::Module& mod, llvm::CodeGenOpt::Level optLevel);
+
+}  // namespace chi
+
+#endif  // CHI_OPTIMIZER_HPP
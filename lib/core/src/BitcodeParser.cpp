@@ -86,4 +86,81 @@ Result parseBitcodeString(const std::string& bitcode, llvm::LLVMContext& ctx,
 	    ctx, toFill);
 }
 
+Result parseBitcodeFileLazy(const boost::filesystem::path& file, llvm::LLVMContext& ctx,
+                            std::unique_ptr<llvm::Module>* toFill) {
+	assert(toFill != nullptr && "Cannot pass a null toFill pointer to parseBitcodeFileLazy");
+
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	return parseBitcodeFile(file, ctx, toFill);
+#else
+	Result res;
+
+	// bitcode doesn't need a null terminator, which lets MemoryBuffer mmap the file
+	auto bcFileBufferOrError =
+	    llvm::MemoryBuffer::getFile(file.string(), -1, /*RequiresNullTerminator=*/false);
+	if (!bcFileBufferOrError) {
+		res.addEntry("EUKN", "Failed to load LLVM module from disk", {{"File", file.string()}});
+		return res;
+	}
+
+	// the module takes ownership of the buffer, function bodies are read from it on demand
+	auto errorOrMod =
+#if LLVM_VERSION_LESS_EQUAL(3, 9)
+	    llvm::getLazyBitcodeModule
+#else
+	    llvm::getOwningLazyBitcodeModule
+#endif
+	    (std::move(bcFileBufferOrError.get()), ctx);
+	if (!errorOrMod) {
+		std::vector<std::string> errorMsgs;
+
+#if LLVM_VERSION_AT_LEAST(4, 0)
+		llvm::handleAllErrors(errorOrMod.takeError(), [&errorMsgs](llvm::ErrorInfoBase& err) {
+			errorMsgs.push_back(err.message());
+		});
+#else
+		errorMsgs.push_back(errorOrMod.getError().message());
+#endif
+
+		res.addEntry("EUKN", "Failed to lazily load bitcode file",
+		             {{"File", file.string()}, {"Error Messages", errorMsgs}});
+		return res;
+	}
+
+	*toFill =
+#if LLVM_VERSION_LESS_EQUAL(3, 6)
+	    std::unique_ptr<llvm::Module>
+#else
+	    std::move
+#endif
+	    (errorOrMod.get());
+
+	return res;
+#endif
+}
+
+Result materializeModule(llvm::Module& mod) {
+	Result res;
+
+#if LLVM_VERSION_AT_LEAST(3, 6)
+	auto err = mod.materializeAll();
+	if (err) {
+		std::vector<std::string> errorMsgs;
+
+#if LLVM_VERSION_AT_LEAST(4, 0)
+		llvm::handleAllErrors(std::move(err), [&errorMsgs](llvm::ErrorInfoBase& info) {
+			errorMsgs.push_back(info.message());
+		});
+#else
+		errorMsgs.push_back(err.message());
+#endif
+
+		res.addEntry("EUKN", "Failed to materialize module",
+		             {{"Module", mod.getModuleIdentifier()}, {"Error Messages", errorMsgs}});
+	}
+#endif
+
+	return res;
+}
+
 }  // namespace chi
@@ -2,6 +2,7 @@
 
 #include "chi/CCompiler.hpp"
 #include "chi/BitcodeParser.hpp"
+#include "chi/ContentHasher.hpp"
 #include "chi/LLVMVersion.hpp"
 #include "chi/Support/LibCLocator.hpp"
 #include "chi/Support/Result.hpp"
@@ -10,25 +11,186 @@
 #include <llvm/IR/Module.h>
 #include <llvm/Support/MemoryBuffer.h>
 
+#ifdef CHI_USE_LIBCLANG
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Basic/Version.h>
+#include <clang/CodeGen/CodeGenAction.h>
+#include <clang/Driver/Compilation.h>
+#include <clang/Driver/Driver.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+
+#if LLVM_VERSION_LESS_EQUAL(3, 9)
+#include <llvm/Bitcode/ReaderWriter.h>
+#else
+#include <llvm/Bitcode/BitcodeWriter.h>
+#endif
+#endif
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <iterator>
+#include <utility>
+
 namespace fs = boost::filesystem;
 
 namespace chi {
 
-Result compileCToLLVM(const boost::filesystem::path& clangPath, llvm::LLVMContext& llvmContext,
-                      std::vector<std::string> arguments, boost::string_view inputCCode,
-                      std::unique_ptr<llvm::Module>* toFill) {
-	assert(toFill != nullptr && "null toFill passed to compileCToLLVM");
-	assert(fs::is_regular_file(clangPath) &&
-	       "invalid path passed to compileCToLLVM for clangPath");
+namespace {
 
-	Result res;
+// Add every regular file under `dir` to `hasher`, in a stable order
+void addDirectory(ContentHasher& hasher, const fs::path& dir) {
+	boost::system::error_code ec;
+	if (!fs::is_directory(dir, ec)) { return; }
+
+	std::vector<fs::path> files;
+	for (const auto& entry : boost::make_iterator_range(
+	         fs::recursive_directory_iterator{dir, fs::symlink_option::recurse, ec}, {})) {
+		if (fs::is_regular_file(entry.path())) { files.push_back(entry.path()); }
+	}
+	std::sort(files.begin(), files.end());
+
+	for (const auto& file : files) { hasher.addFile(file); }
+}
+
+// The version of the clang libraries that are linked in, if chigraph is built with
+// CG_USE_LIBCLANG
+std::string linkedClangVersion() {
+#ifdef CHI_USE_LIBCLANG
+	return clang::getClangFullVersion();
+#else
+	return {};
+#endif
+}
+
+// Get the path in `cacheDir` for the bitcode clang generates with `arguments` for `inputCCode`.
+// The key covers the code, the arguments, the contents of the input files and of the directories
+// that are searched for headers, the standard include paths and the clang that generates it,
+// which is the linked in clang libraries if `inProcess` is set and the clang executable otherwise.
+// The directories of the input files are only read if there's no `headersDigest` for them
+fs::path cachePathFor(const fs::path& cacheDir, const fs::path& clangPath, bool inProcess,
+                      const std::vector<std::string>& arguments,
+                      const std::vector<fs::path>& stdIncludePaths, boost::string_view inputCCode,
+                      boost::string_view headersDigest) {
+	ContentHasher hasher;
+	hasher.addCompilerVersion();
+
+	boost::system::error_code ec;
+	hasher.add(clangPath.generic_string());
+	if (inProcess) {
+		hasher.add("in process");
+		hasher.add(linkedClangVersion());
+	} else {
+		// hashing all of clang would take longer than running it, so use when it was installed
+		hasher.add(std::to_string(fs::file_size(clangPath, ec)));
+		hasher.add(std::to_string(fs::last_write_time(clangPath, ec)));
+	}
+
+	hasher.add(inputCCode);
+	hasher.add(headersDigest);
+
+	// the standard headers come with the system, so their paths are enough
+	for (const auto& p : stdIncludePaths) { hasher.add(p.generic_string()); }
+
+	for (auto argIter = arguments.begin(); argIter != arguments.end(); ++argIter) {
+		hasher.add(*argIter);
+
+		// other headers can come from the -I directories, and from an input file's directory
+		if (*argIter == "-I" && argIter + 1 != arguments.end()) {
+			addDirectory(hasher, *(argIter + 1));
+		} else if (argIter->size() > 2 && argIter->compare(0, 2, "-I") == 0) {
+			addDirectory(hasher, argIter->substr(2));
+		} else if (fs::is_regular_file(*argIter, ec)) {
+			hasher.addFile(*argIter);
+			if (headersDigest.empty()) { addDirectory(hasher, fs::path{*argIter}.parent_path()); }
+		}
+	}
+
+	return cacheDir / (hasher.hash() + ".bc");
+}
 
+// Store `bitcode` in the cache at `cachePath`. A cache that can't be written to isn't an error.
+void storeInCache(const fs::path& cachePath, const std::string& bitcode) {
+	boost::system::error_code ec;
+	fs::create_directories(cachePath.parent_path(), ec);
+	if (ec) { return; }
+
+	// write to a temporary file first, so nobody reads half written bitcode
+	auto tmpPath = cachePath;
+	tmpPath += "." + fs::unique_path().string() + ".tmp";
+	{
+		fs::ofstream stream{tmpPath, std::ios::binary};
+		stream.write(bitcode.data(), bitcode.size());
+		if (!stream) { return; }
+	}
+
+	fs::rename(tmpPath, cachePath, ec);
+	if (ec) {
+		fs::remove(tmpPath, ec);
+		return;
+	}
+
+	// remove the least recently used bitcode
+	std::vector<std::pair<std::time_t, fs::path>> cached;
+	for (const auto& entry :
+	     boost::make_iterator_range(fs::directory_iterator{cachePath.parent_path(), ec}, {})) {
+		if (fs::is_regular_file(entry.path()) && entry.path().extension() == ".bc") {
+			cached.emplace_back(fs::last_write_time(entry.path(), ec), entry.path());
+		}
+	}
+	if (cached.size() <= maxCachedCBitcodeFiles) { return; }
+
+	std::sort(cached.begin(), cached.end(),
+	          [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+	for (auto idx = maxCachedCBitcodeFiles; idx < cached.size(); ++idx) {
+		fs::remove(cached[idx].second, ec);
+	}
+}
+
+// Read the bitcode cached at `cachePath` into `toFill`. If it isn't there or can't be read, it
+// has to be compiled again
+bool readFromCache(const fs::path& cachePath, std::string* toFill) {
+	if (cachePath.empty() || !fs::is_regular_file(cachePath)) { return false; }
+
+	fs::ifstream stream{cachePath, std::ios::binary};
+	std::string  cached{std::istreambuf_iterator<char>{stream}, {}};
+	if (!stream || cached.empty()) { return false; }
+
+	// mark it as used so it isn't pruned
+	boost::system::error_code ec;
+	fs::last_write_time(cachePath, std::time(nullptr), ec);
+
+	*toFill = std::move(cached);
+	return true;
+}
+
+// Get the standard include paths, and add them and the arguments to generate bitcode to
+// `arguments`. `cachePath` is set to where the output is cached if `cacheDir` isn't empty, see
+// cachePathFor.
+Result prepareArguments(const fs::path& clangPath, bool inProcess,
+                        std::vector<std::string>& arguments, boost::string_view inputCCode,
+                        const fs::path& cacheDir, boost::string_view headersDigest,
+                        fs::path* cachePath) {
+	Result res;
 
 	// gather std include paths
 	std::vector<fs::path> stdIncludePaths;
 	res += stdCIncludePaths(stdIncludePaths);
 	if (!res) { return res; }
 
+	// the rest of the arguments only depend on these, so they're enough for the cache key
+	if (!cacheDir.empty()) {
+		*cachePath = cachePathFor(cacheDir, clangPath, inProcess, arguments, stdIncludePaths,
+		                          inputCCode, headersDigest);
+	}
+
 	for (const auto& p : stdIncludePaths) {
 		arguments.push_back("-I");
 		arguments.push_back(p.string());
@@ -47,52 +209,195 @@ Result compileCToLLVM(const boost::filesystem::path& clangPath, llvm::LLVMContex
 	arguments.emplace_back("-o");
 	arguments.emplace_back("-");
 
+	return res;
+}
+
+#ifdef CHI_USE_LIBCLANG
+
+// Run the clang frontend in this process, generating the module straight into `llvmContext`.
+// `arguments` are the same as for the clang executable, the driver turns them into frontend
+// arguments. Warnings are put in `errors`.
+Result compileInProcess(const fs::path& clangPath, llvm::LLVMContext& llvmContext,
+                        const std::vector<std::string>& arguments, boost::string_view inputCCode,
+                        std::unique_ptr<llvm::Module>* toFill, std::string* errors) {
+	Result res;
+
+	llvm::raw_string_ostream errStream{*errors};
+
+	llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagOpts{new clang::DiagnosticOptions};
+	clang::DiagnosticsEngine diags{new clang::DiagnosticIDs, diagOpts.get(),
+	                               new clang::TextDiagnosticPrinter{errStream, diagOpts.get()}};
+
+	// let the driver work out the frontend arguments, like it does for the executable
+	auto                     clangPathStr = clangPath.string();
+	std::vector<const char*> driverArgs{clangPathStr.c_str()};
+	for (const auto& arg : arguments) { driverArgs.push_back(arg.c_str()); }
+
+	clang::driver::Driver driver{clangPathStr, llvm::sys::getDefaultTargetTriple(), diags};
+	std::unique_ptr<clang::driver::Compilation> compilation{driver.BuildCompilation(driverArgs)};
+	if (compilation == nullptr || diags.hasErrorOccurred() ||
+	    compilation->getJobs().size() != 1) {
+		res.addEntry("EUKN", "Failed to create a clang compilation",
+		             {{"Error", errStream.str()}});
+		return res;
+	}
+	const auto& frontendArgs = compilation->getJobs().begin()->getArguments();
+
+#if LLVM_VERSION_AT_LEAST(4, 0)
+	auto invocation = std::make_shared<clang::CompilerInvocation>();
+#else
+	auto invocation = new clang::CompilerInvocation;
+#endif
+	if (!clang::CompilerInvocation::CreateFromArgs(*invocation, frontendArgs.data(),
+	                                               frontendArgs.data() + frontendArgs.size(),
+	                                               diags)) {
+		res.addEntry("EUKN", "Failed to create a clang invocation", {{"Error", errStream.str()}});
+		return res;
+	}
+
+	// the code comes from memory instead of stdin, which is the only input with -x c -
+	auto inputBuffer = llvm::MemoryBuffer::getMemBuffer(
+	    llvm::StringRef{inputCCode.data(), inputCCode.size()}, "<c-code>", false);
+	if (!inputCCode.empty()) {
+		auto& inputs = invocation->getFrontendOpts().Inputs;
+		assert(inputs.size() == 1);
+
+		auto kind = inputs[0].getKind();
+		inputs.clear();
+		inputs.emplace_back(inputBuffer.get(), kind);
+	}
+
+	clang::CompilerInstance compiler;
+	compiler.setInvocation(std::move(invocation));
+	compiler.createDiagnostics(
+	    new clang::TextDiagnosticPrinter{errStream, &compiler.getDiagnosticOpts()});
+
+	clang::EmitLLVMOnlyAction action{&llvmContext};
+	if (!compiler.ExecuteAction(action)) {
+		res.addEntry("EUKN", "Failed to Generate IR with clang", {{"Error", errStream.str()}});
+		return res;
+	}
+
+	*toFill = action.takeModule();
+	errStream.flush();
+
+	return res;
+}
+
+#endif
+
+}  // anonymous namespace
+
+std::string hashCHeaders(const boost::filesystem::path& dir) {
+	ContentHasher hasher;
+	addDirectory(hasher, dir);
+	return hasher.hash();
+}
+
+Result compileCToBitcode(const boost::filesystem::path& clangPath,
+                         std::vector<std::string> arguments, boost::string_view inputCCode,
+                         std::string* toFill, const boost::filesystem::path& cacheDir,
+                         boost::string_view headersDigest) {
+	assert(toFill != nullptr && "null toFill passed to compileCToBitcode");
+	assert(fs::is_regular_file(clangPath) &&
+	       "invalid path passed to compileCToBitcode for clangPath");
+
+	Result res;
+
+	fs::path cachePath;
+	res += prepareArguments(clangPath, false, arguments, inputCCode, cacheDir, headersDigest,
+	                        &cachePath);
+	if (!res) { return res; }
 
 	auto argumentsContext = res.addScopedContext({{"clang arguments", arguments}});
 
+	// see if this exact code has been compiled before
+	if (readFromCache(cachePath, toFill)) { return res; }
+
 	std::string errors;
 
 	// call clang
-	std::unique_ptr<llvm::Module> mod;
-	{
+	Subprocess clangExe(clangPath);
+	clangExe.setArguments(arguments);
 
-		std::string generatedBitcode;
-		Subprocess  clangExe(clangPath);
-		clangExe.setArguments(arguments);
+	clangExe.attachStringToStdOut(*toFill);
+	clangExe.attachStringToStdErr(errors);
 
-		clangExe.attachStringToStdOut(generatedBitcode);
-		clangExe.attachStringToStdErr(errors);
+	res += clangExe.start();
 
-		res += clangExe.start();
+	// push it the code and close the stream
+	res += clangExe.pushToStdIn(inputCCode.data(), inputCCode.size());
+	res += clangExe.closeStdIn();
 
-		// push it the code and close the stream
-		res += clangExe.pushToStdIn(inputCCode.data(), inputCCode.size());
-		res += clangExe.closeStdIn();
+	if (!res) { return res; }
 
-		if (!res) { return res; }
+	// wait for the exit
+	auto errCode = clangExe.exitCode();
 
-		// wait for the exit
-		auto errCode = clangExe.exitCode();
+	if (errCode != 0) {
+		res.addEntry("EUKN", "Failed to Generate IR with clang", {{"Error", errors}});
+		return res;
+	}
+	if (!errors.empty()) {
+		res.addEntry("WUKN", "Warnings emitted while generating IR with clang",
+		             {{"Warning", errors}});
+	} else if (!cachePath.empty()) {
+		// warnings would be lost if it came from the cache next time, so only cache clean output
+		storeInCache(cachePath, *toFill);
+	}
+
+	return res;
+}
+
+Result compileCToLLVM(const boost::filesystem::path& clangPath, llvm::LLVMContext& llvmContext,
+                      std::vector<std::string> arguments, boost::string_view inputCCode,
+                      std::unique_ptr<llvm::Module>*  toFill,
+                      const boost::filesystem::path& cacheDir) {
+	assert(toFill != nullptr && "null toFill passed to compileCToLLVM");
+
+	Result res;
+
+	std::string generatedBitcode;
+#ifdef CHI_USE_LIBCLANG
+	assert(fs::is_regular_file(clangPath) &&
+	       "invalid path passed to compileCToLLVM for clangPath");
+
+	fs::path cachePath;
+	res += prepareArguments(clangPath, true, arguments, inputCCode, cacheDir, {}, &cachePath);
+	if (!res) { return res; }
+
+	auto argumentsContext = res.addScopedContext({{"clang arguments", arguments}});
+
+	// only go through bitcode if it's already cached
+	if (!readFromCache(cachePath, &generatedBitcode)) {
+		std::string errors;
+		res += compileInProcess(clangPath, llvmContext, arguments, inputCCode, toFill, &errors);
+		if (!res) { return res; }
 
-		if (errCode != 0) {
-			res.addEntry("EUKN", "Failed to Generate IR with clang", {{"Error", errors}});
-			return res;
-		}
 		if (!errors.empty()) {
 			res.addEntry("WUKN", "Warnings emitted while generating IR with clang",
 			             {{"Warning", errors}});
+		} else if (!cachePath.empty()) {
+			{
+				llvm::raw_string_ostream stream{generatedBitcode};
+				llvm::WriteBitcodeToFile(toFill->get(), stream);
+			}
+			storeInCache(cachePath, generatedBitcode);
 		}
-
-		auto readCtx = res.addScopedContext(
-		    {{"Error parsing bitcode file generated from clang", &inputCCode[0]}});
-		res += parseBitcodeString(generatedBitcode, llvmContext, toFill);
+		return res;
 	}
+#else
+	res += compileCToBitcode(clangPath, std::move(arguments), inputCCode, &generatedBitcode,
+	                         cacheDir);
+	if (!res) { return res; }
+#endif
+
+	auto readCtx = res.addScopedContext(
+	    {{"Error parsing bitcode file generated from clang", inputCCode.to_string()}});
+	res += parseBitcodeString(generatedBitcode, llvmContext, toFill);
 
 	if (*toFill == nullptr) {
-		res.addEntry("EUKN", "Failed to generate IR with clang", {{"Error", errors}});
-	} else if (!errors.empty()) {
-		res.addEntry("WUKN", "Warnings encountered while generating IR with clang",
-		             {{"Error", errors}});
+		res.addEntry("EUKN", "Failed to generate IR with clang", nlohmann::json::object());
 	}
 
 	return res;
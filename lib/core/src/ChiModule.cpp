@@ -1,6 +1,7 @@
 /// \file ChiModule.cpp
 
 #include "chi/ChiModule.hpp"
+#include "chi/ContentHasher.hpp"
 #include "chi/Context.hpp"
 #include "chi/Support/Result.hpp"
 
@@ -17,4 +18,11 @@ Result ChiModule::addDependency(boost::filesystem::path newDepFullPath) {
 
 	return res;
 }
+
+std::string ChiModule::contentHash() const {
+	ContentHasher hasher;
+	hasher.add(fullName());
+	hasher.add(std::to_string(lastEditTime()));
+	return hasher.hash();
+}
 }  // namespace chi
@@ -6,11 +6,16 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/preprocessor/stringize.hpp>
 
+#include <mutex>
+
 namespace fs = boost::filesystem;
 
 namespace chi {
 
-fs::path findClang() {
+namespace {
+
+// Look for clang next to the executable and then in the path
+fs::path searchForClang() {
 	fs::path fileName = std::string("clang-") + BOOST_PP_STRINGIZE(LLVM_VERSION_MAJOR) + "." +
 	                    BOOST_PP_STRINGIZE(LLVM_VERSION_MINOR)
 #ifdef WIN32
@@ -18,12 +23,6 @@ fs::path findClang() {
 #endif
 	    ;
 
-	// 1st location--CHI_CLANG_EXECUTABLE environment variable
-	{
-		const char* envVar = std::getenv("CHI_CLANG_EXECUTABLE");
-		if (envVar != nullptr) { return envVar; }
-	}
-
 	// 2st location--current executable path
 	{
 		auto exeLoc = fs::path(llvm::sys::fs::getMainExecutable(nullptr, nullptr)).parent_path();
@@ -43,4 +42,23 @@ fs::path findClang() {
 
 	return {};
 }
+
+}  // anonymous namespace
+
+fs::path findClang() {
+	// 1st location--CHI_CLANG_EXECUTABLE environment variable
+	{
+		const char* envVar = std::getenv("CHI_CLANG_EXECUTABLE");
+		if (envVar != nullptr) { return envVar; }
+	}
+
+	// searching the path takes a while, so remember where clang was found. If it wasn't, it may be
+	// installed later, so search again next time
+	static std::mutex foundMutex;
+	static fs::path   found;
+
+	std::lock_guard<std::mutex> lock{foundMutex};
+	if (found.empty()) { found = searchForClang(); }
+	return found;
+}
 }  // namespace chi
@@ -0,0 +1,191 @@
+/// \file CompiledFunction.cpp
+
+#include "chi/CompiledFunction.hpp"
+#include "chi/GraphFunction.hpp"
+#include "chi/GraphModule.hpp"
+#include "chi/LLVMVersion.hpp"
+#include "chi/NameMangler.hpp"
+#include "chi/Optimizer.hpp"
+#include "chi/Support/Result.hpp"
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/DebugInfo.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <cassert>
+#include <cstdint>
+
+namespace chi {
+
+namespace {
+
+// Generate a function that calls `callee` once for each record in struct-of-arrays buffers. It has
+// the signature of CompiledFunction::BatchSignature, and is named `callee`'s name + ".batch",
+// which can't collide with a mangled name
+llvm::Function* generateBatchDriver(llvm::Function& callee, size_t numInputs) {
+	auto& llctx    = callee.getContext();
+	auto  calleeTy = callee.getFunctionType();
+
+	auto i32Ty      = llvm::IntegerType::getInt32Ty(llctx);
+	auto i64Ty      = llvm::IntegerType::getInt64Ty(llctx);
+	auto bufferTy   = llvm::PointerType::get(llvm::IntegerType::getInt8Ty(llctx), 0);
+	auto bufferArTy = llvm::PointerType::get(bufferTy, 0);
+
+	auto driverTy = llvm::FunctionType::get(
+	    llvm::Type::getVoidTy(llctx),
+	    {i64Ty, i32Ty, bufferArTy, bufferArTy, llvm::PointerType::get(i32Ty, 0)}, false);
+	auto driver = llvm::Function::Create(driverTy, llvm::GlobalValue::ExternalLinkage,
+	                                     callee.getName() + ".batch", callee.getParent());
+
+	auto argIter     = driver->arg_begin();
+	auto count       = &*argIter++;
+	auto execInput   = &*argIter++;
+	auto inputs      = &*argIter++;
+	auto outputs     = &*argIter++;
+	auto execOutputs = &*argIter++;
+
+	auto entryBlock = llvm::BasicBlock::Create(llctx, "entry", driver);
+	auto loopBlock  = llvm::BasicBlock::Create(llctx, "loop", driver);
+	auto exitBlock  = llvm::BasicBlock::Create(llctx, "exit", driver);
+
+	// get the typed pointer to each array once, outside of the loop
+	llvm::IRBuilder<>         builder{entryBlock};
+	std::vector<llvm::Value*> arrays;
+	for (auto idx = 1u; idx < calleeTy->getNumParams(); ++idx) {
+		auto isInput  = idx - 1 < numInputs;
+		auto elemTy   = isInput ? calleeTy->getParamType(idx)
+		                      : calleeTy->getParamType(idx)->getPointerElementType();
+		auto tableIdx = isInput ? idx - 1 : idx - 1 - numInputs;
+
+		auto buffer = builder.CreateLoad(builder.CreateConstInBoundsGEP1_64(
+		    isInput ? inputs : outputs, tableIdx));
+		arrays.push_back(builder.CreatePointerCast(buffer, llvm::PointerType::get(elemTy, 0)));
+	}
+	// a count that isn't positive runs nothing, instead of looping until it runs off the buffers
+	builder.CreateCondBr(builder.CreateICmpSLE(count, llvm::ConstantInt::get(i64Ty, 0)), exitBlock,
+	                     loopBlock);
+
+	// call the function with the record at `recordIdx`
+	builder.SetInsertPoint(loopBlock);
+	auto recordIdx = builder.CreatePHI(i64Ty, 2);
+	recordIdx->addIncoming(llvm::ConstantInt::get(i64Ty, 0), entryBlock);
+
+	std::vector<llvm::Value*> args{execInput};
+	for (auto idx = 0ull; idx < arrays.size(); ++idx) {
+		auto elemPtr = builder.CreateInBoundsGEP(arrays[idx], recordIdx);
+		args.push_back(idx < numInputs ? builder.CreateLoad(elemPtr) : elemPtr);
+	}
+	auto execOutput = builder.CreateCall(&callee, args);
+	builder.CreateStore(execOutput, builder.CreateInBoundsGEP(execOutputs, recordIdx));
+
+	auto nextIdx = builder.CreateAdd(recordIdx, llvm::ConstantInt::get(i64Ty, 1), "", true, true);
+	recordIdx->addIncoming(nextIdx, loopBlock);
+	builder.CreateCondBr(builder.CreateICmpSGE(nextIdx, count), exitBlock, loopBlock);
+
+	builder.SetInsertPoint(exitBlock);
+	builder.CreateRetVoid();
+
+	return driver;
+}
+
+}  // anonymous namespace
+
+CompiledFunction::CompiledFunction(std::unique_ptr<llvm::ExecutionEngine> engine, void* address,
+                                   void* batchAddress, std::string mangledName)
+    : mEngine{std::move(engine)},
+      mAddress{address},
+      mBatchAddress{batchAddress},
+      mMangledName{std::move(mangledName)} {}
+
+CompiledFunction::~CompiledFunction() { mEngine->runStaticConstructorsDestructors(true); }
+
+Result CompiledFunction::compile(GraphFunction& func, std::unique_ptr<CompiledFunction>* toFill,
+                                 llvm::CodeGenOpt::Level optLevel,
+                                 Flags<CompileSettings>  settings) {
+	assert(toFill != nullptr && "Cannot pass a null toFill to CompiledFunction::compile");
+
+	Result res;
+
+	auto funcCtx = res.addScopedContext(
+	    {{"Function", func.name()}, {"Module", func.module().fullName()}});
+
+	std::unique_ptr<llvm::Module> llmod;
+	res += func.context().compileModule(func.module(), settings | CompileSettings::LinkDependencies,
+	                                    &llmod);
+	if (!res) { return res; }
+
+	auto mangledName = mangleFunctionName(func.module().fullName(), func.name());
+
+	auto llfunc = llmod->getFunction(mangledName);
+	if (llfunc == nullptr) {
+		res.addEntry("EINT", "Function wasn't in the compiled module",
+		             {{"Mangled Name", mangledName}});
+		return res;
+	}
+
+	// nothing reads debug info from this code, and the calls from the batch driver (which has none)
+	// would be invalid once they're inlined
+	llvm::StripDebugInfo(*llmod);
+
+	auto batchName = generateBatchDriver(*llfunc, func.dataInputs().size())->getName().str();
+
+	optimizeModule(*llmod, optLevel);
+
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+	llvm::InitializeNativeTargetAsmParser();
+
+	std::string errMsg;
+
+	llvm::EngineBuilder EEBuilder(
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	    llmod.release()
+#else
+	    std::move(llmod)
+#endif
+	        );
+
+	EEBuilder.setEngineKind(llvm::EngineKind::JIT);
+	EEBuilder.setOptLevel(optLevel);
+	EEBuilder.setErrorStr(&errMsg);
+
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	EEBuilder.setUseMCJIT(true);
+#endif
+
+	EEBuilder.setMCJITMemoryManager(
+#if LLVM_VERSION_AT_LEAST(3, 6)
+	    std::unique_ptr<llvm::SectionMemoryManager>
+#endif
+	    (new llvm::SectionMemoryManager()));
+
+	std::unique_ptr<llvm::ExecutionEngine> EE{EEBuilder.create()};
+	if (!EE) {
+		res.addEntry("EINT", "Failed to create an LLVM ExecutionEngine", {{"Error", errMsg}});
+		return res;
+	}
+
+	// generate all the native code now, so calls don't have to
+	auto address      = EE->getFunctionAddress(mangledName);
+	auto batchAddress = EE->getFunctionAddress(batchName);
+	EE->finalizeObject();
+	if (address == 0 || batchAddress == 0) {
+		res.addEntry("EINT", "Failed to get the address of the compiled function",
+		             {{"Mangled Name", mangledName}, {"Error", errMsg}});
+		return res;
+	}
+
+	EE->runStaticConstructorsDestructors(false);
+
+	toFill->reset(new CompiledFunction(
+	    std::move(EE), reinterpret_cast<void*>(static_cast<uintptr_t>(address)),
+	    reinterpret_cast<void*>(static_cast<uintptr_t>(batchAddress)), std::move(mangledName)));
+
+	return res;
+}
+
+}  // namespace chi
@@ -0,0 +1,53 @@
+/// \file ContentHasher.cpp
+
+#include "chi/ContentHasher.hpp"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Config/llvm-config.h>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <sstream>
+
+namespace chi {
+
+namespace {
+
+// Bump this whenever the code generated for a module changes, so old caches are ignored
+constexpr auto codegenVersion = "6";
+
+}  // anonymous namespace
+
+void ContentHasher::add(boost::string_view data) {
+	auto size = std::to_string(data.size()) + ":";
+	mMD5.update(size);
+	mMD5.update(llvm::StringRef(data.data(), data.size()));
+}
+
+void ContentHasher::addFile(const boost::filesystem::path& file) {
+	add(file.generic_string());
+
+	boost::filesystem::ifstream stream{file, std::ios::binary};
+	if (!stream) { return; }
+
+	std::stringstream contents;
+	contents << stream.rdbuf();
+	add(contents.str());
+}
+
+void ContentHasher::addCompilerVersion() {
+	add(LLVM_VERSION_STRING);
+	add(codegenVersion);
+}
+
+std::string ContentHasher::hash() {
+	llvm::MD5::MD5Result result;
+	mMD5.final(result);
+
+	llvm::SmallString<32> str;
+	llvm::MD5::stringifyResult(result, str);
+
+	return str.str().str();
+}
+
+}  // namespace chi
@@ -2,21 +2,49 @@
 
 #include "chi/Context.hpp"
 #include "chi/BitcodeParser.hpp"
+#include "chi/ContentHasher.hpp"
 #include "chi/DefaultModuleCache.hpp"
 #include "chi/GraphFunction.hpp"
 #include "chi/NodeType.hpp"
 #include "chi/GraphModule.hpp"
 #include "chi/GraphStruct.hpp"
 #include "chi/JsonDeserializer.hpp"
+#include "chi/JsonSerializer.hpp"
 #include "chi/LLVMVersion.hpp"
 #include "chi/LangModule.hpp"
+#include "chi/NameMangler.hpp"
 #include "chi/NodeInstance.hpp"
 #include "chi/Support/ExecutablePath.hpp"
+#include "chi/Support/ParallelFor.hpp"
 #include "chi/Support/Result.hpp"
 
+#if LLVM_VERSION_LESS_EQUAL(3, 9)
+#include <llvm/Bitcode/ReaderWriter.h>
+#else
+#include <llvm/Bitcode/BitcodeWriter.h>
+#endif
+
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#if LLVM_VERSION_AT_LEAST(5, 0)
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/Support/DynamicLibrary.h>
+#endif
+#include <llvm/IR/DataLayout.h>
+#if LLVM_VERSION_AT_LEAST(3, 8)
+#include <llvm/IR/DebugInfoMetadata.h>
+#endif
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
@@ -26,12 +54,22 @@
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#if LLVM_VERSION_AT_LEAST(4, 0)
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#endif
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/range.hpp>
 
+#include <algorithm>
 #include <deque>
+#include <set>
+#include <functional>
 #include <unordered_set>
 
 namespace fs = boost::filesystem;
@@ -281,22 +319,191 @@ std::unique_ptr<NodeType> Context::createConverterNodeType(const DataType& fromT
 }
 
 
-Result Context::compileModule(const boost::filesystem::path& fullName,
-                              Flags<CompileSettings>         settings,
-                              std::unique_ptr<llvm::Module>* toFill) {
+namespace {
+
+// Link `toLink` into `into`. If `onlyNeeded` is set, only the definitions that `into` references
+// are linked, so unused functions in lazily loaded modules are never materialized
+Result linkModule(llvm::Module& into, std::unique_ptr<llvm::Module> toLink,
+                  bool onlyNeeded = false) {
 	Result res;
 
-	auto mod = moduleByFullName(fullName);
-	if (mod == nullptr) {
-		res.addEntry("E36", "Could not find module", {{"module", fullName.generic_string()}});
-		return res;
+	// the linker consumes `toLink`, so get its name for errors first
+	auto moduleName = toLink->getModuleIdentifier();
+
+#if LLVM_VERSION_LESS_EQUAL(3, 7)
+	// these linkers don't materialize the source themselves
+	res += materializeModule(*toLink);
+	if (!res) { return res; }
+
+	auto failed = llvm::Linker::LinkModules(&into, toLink.get()
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	                                                       ,
+	                                        llvm::Linker::DestroySource, nullptr
+#endif
+	                                        );
+#else
+	auto failed = llvm::Linker::linkModules(
+	    into, std::move(toLink),
+	    onlyNeeded ? llvm::Linker::Flags::LinkOnlyNeeded : llvm::Linker::Flags::None);
+#endif
+	if (failed) {
+		res.addEntry("EUKN", "Failed to link module", {{"Module", moduleName}});
 	}
 
-	return compileModule(*mod, settings, toFill);
+	return res;
 }
 
-Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
-                              std::unique_ptr<llvm::Module>* toFill) {
+// Get `root` and all the modules it depends on (directly or not), ordered so every module comes
+// after its dependencies. Dependencies are visited in name order, so the order is stable.
+Result dependencyOrder(Context& ctx, ChiModule& root, std::vector<ChiModule*>* toFill) {
+	assert(toFill != nullptr);
+
+	Result res;
+
+	// modules in `visiting` are on the current path from root, so seeing one again is a cycle
+	std::unordered_set<ChiModule*> visiting;
+	std::unordered_set<ChiModule*> visited;
+	std::vector<ChiModule*>        path;
+
+	std::function<bool(ChiModule&)> visit = [&](ChiModule& mod) {
+		if (visited.find(&mod) != visited.end()) { return true; }
+
+		if (visiting.find(&mod) != visiting.end()) {
+			auto cycle = nlohmann::json::array();
+			for (auto iter = std::find(path.begin(), path.end(), &mod); iter != path.end();
+			     ++iter) {
+				cycle.push_back((*iter)->fullName());
+			}
+			cycle.push_back(mod.fullName());
+
+			res.addEntry("EUKN", "Circular module dependency", {{"Cycle", cycle}});
+			return false;
+		}
+
+		visiting.insert(&mod);
+		path.push_back(&mod);
+
+		for (const auto& depName : mod.dependencies()) {
+			auto depMod = ctx.moduleByFullName(depName);
+			if (depMod == nullptr) {
+				res.addEntry("E36", "Could not find module",
+				             {{"module", depName.generic_string()}});
+				return false;
+			}
+
+			if (!visit(*depMod)) { return false; }
+		}
+
+		path.pop_back();
+		visiting.erase(&mod);
+		visited.insert(&mod);
+
+		toFill->push_back(&mod);
+		return true;
+	};
+
+	visit(root);
+
+	return res;
+}
+
+// The functions in each GraphModule that need to be generated
+using ReachableFunctions = std::unordered_map<ChiModule*, std::unordered_set<std::string>>;
+
+// Find the functions in each GraphModule that can be called from the functions in `root`, which
+// are the entry points. `root` is always in the map, with all of its functions, and GraphModules
+// that aren't in it have no reachable functions at all.
+ReachableFunctions reachableFunctions(ChiModule& root) {
+	ReachableFunctions reachable;
+	auto&              rootFunctions = reachable[&root];
+
+	auto rootGraph = dynamic_cast<GraphModule*>(&root);
+	if (rootGraph == nullptr) { return reachable; }
+
+	std::deque<GraphFunction*> toVisit;
+	for (const auto& func : rootGraph->functions()) {
+		rootFunctions.insert(func->name());
+		toVisit.push_back(func.get());
+	}
+
+	while (!toVisit.empty()) {
+		auto func = toVisit.front();
+		toVisit.pop_front();
+
+		// calls to graph functions are the only nodes that need other functions
+		for (const auto& node : func->nodes()) {
+			auto calleeModule = dynamic_cast<GraphModule*>(&node.second->type().module());
+			if (calleeModule == nullptr) { continue; }
+
+			auto callee = calleeModule->functionFromName(node.second->type().name());
+			if (callee != nullptr && reachable[calleeModule].insert(callee->name()).second) {
+				toVisit.push_back(callee);
+			}
+		}
+	}
+
+	return reachable;
+}
+
+// The settings that change the code generateModule makes
+Flags<CompileSettings> codegenSettings() {
+	return Flags<CompileSettings>{CompileSettings::SSAOutputs} | CompileSettings::FoldConstants |
+	       CompileSettings::InlineFunctions;
+}
+
+// A string for the settings that change code generation, to go in cache keys
+std::string codegenSettingsKey(Flags<CompileSettings> settings) {
+	std::string key;
+	if (settings & CompileSettings::SSAOutputs) { key += "ssa;"; }
+	if (settings & CompileSettings::FoldConstants) { key += "fold;"; }
+	if (settings & CompileSettings::InlineFunctions) { key += "inline;"; }
+	return key;
+}
+
+// Get the module cache key of each module in `order`, which has dependencies first. A module's
+// key covers its content, the keys of its dependencies, the compiler version, the settings that
+// change code generation and which of its functions are generated, so it changes whenever
+// anything that could change its generated code does.
+std::unordered_map<ChiModule*, std::string> moduleCacheKeys(
+    Context& ctx, const std::vector<ChiModule*>& order, Flags<CompileSettings> settings,
+    const ReachableFunctions& reachable) {
+	std::unordered_map<ChiModule*, std::string> keys;
+
+	for (auto mod : order) {
+		ContentHasher hasher;
+		hasher.addCompilerVersion();
+		hasher.add(codegenSettingsKey(settings));
+		hasher.add(mod->fullName());
+		hasher.add(mod->contentHash());
+
+		// only modules with some of their functions generated need them in the key
+		auto graphMod      = dynamic_cast<GraphModule*>(mod);
+		auto reachableIter = reachable.find(mod);
+		if (graphMod != nullptr && reachableIter != reachable.end() &&
+		    reachableIter->second.size() != graphMod->functions().size()) {
+			std::set<std::string> sortedFunctions(reachableIter->second.begin(),
+			                                      reachableIter->second.end());
+			for (const auto& funcName : sortedFunctions) { hasher.add(funcName); }
+		}
+
+		for (const auto& depName : mod->dependencies()) {
+			hasher.add(depName.generic_string());
+			hasher.add(keys[ctx.moduleByFullName(depName)]);
+		}
+
+		keys[mod] = hasher.hash();
+	}
+
+	return keys;
+}
+
+// Generate one module, or get it from the cache, without linking anything into it. Settings other
+// than UseCache are only passed on to generateModule. If `functions` isn't null, only those
+// functions are generated (if it's a GraphModule)
+Result compileSingleModule(Context& ctx, ChiModule& mod, Flags<CompileSettings> settings,
+                           const std::string&                     cacheKey,
+                           const std::unordered_set<std::string>* functions,
+                           std::unique_ptr<llvm::Module>*         toFill) {
 	assert(toFill != nullptr);
 
 	Result res;
@@ -308,12 +515,19 @@ Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
 	{
 		// try to get it from the cache
 		if (settings & CompileSettings::UseCache) {
-			llmod = moduleCache().retrieveFromCache(mod.fullNamePath(), mod.lastEditTime());
+			llmod = ctx.moduleCache().retrieveFromCache(mod.fullNamePath(), cacheKey);
+		}
+
+		// cached modules were verified when they were generated, and verifying would materialize
+		// them
+		if (llmod) {
+			*toFill = std::move(llmod);
+			return res;
 		}
 
 		// compile it if the cache failed or if
 		if (!llmod) {
-			llmod = std::make_unique<llvm::Module>(mod.fullName(), llvmContext());
+			llmod = std::make_unique<llvm::Module>(mod.fullName(), ctx.llvmContext());
 
 			// add forward declartions for all dependencies
 			{
@@ -324,7 +538,7 @@ Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
 				while (!depsToAdd.empty()) {
 					auto& depName = depsToAdd[0];
 
-					auto depMod = moduleByFullName(depName);
+					auto depMod = ctx.moduleByFullName(depName);
 					if (depMod == nullptr) {
 						res.addEntry("E36", "Could not find module",
 						             {{"module", depName.generic_string()}});
@@ -344,7 +558,12 @@ Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
 				}
 			}
 
-			res += mod.generateModule(*llmod);
+			auto graphMod = dynamic_cast<GraphModule*>(&mod);
+			if (functions != nullptr && graphMod != nullptr) {
+				res += graphMod->generateModule(*llmod, settings & codegenSettings(), *functions);
+			} else {
+				res += mod.generateModule(*llmod, settings & codegenSettings());
+			}
 
 			// set debug info version if it doesn't already have it
 			if (llmod->getModuleFlag("Debug Info Version") == nullptr) {
@@ -381,64 +600,559 @@ Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
 #endif
 
 	// cache the module
-	res += moduleCache().cacheModule(mod.fullNamePath(), *llmod, mod.lastEditTime());
+	res += ctx.moduleCache().cacheModule(mod.fullNamePath(), *llmod, cacheKey);
 
-	// generate dependencies
-	if (settings & CompileSettings::LinkDependencies) {
-		for (const auto& depName : mod.dependencies()) {
-			std::unique_ptr<llvm::Module> compiledDep;
-			res += compileModule(depName, settings,
-			                     &compiledDep);  // TODO(#62): detect circular dependencies
+	*toFill = std::move(llmod);
 
-			if (!res) { return res; }
+	return res;
+}
 
-// link it in
-#if LLVM_VERSION_LESS_EQUAL(3, 7)
-			llvm::Linker::LinkModules(llmod.get(), compiledDep.get()
-#if LLVM_VERSION_LESS_EQUAL(3, 5)
-			                                           ,
-			                          llvm::Linker::DestroySource, nullptr
+// A ModuleCache that never stores anything, for Contexts that only live for one compile
+struct NullModuleCache : ModuleCache {
+	using ModuleCache::ModuleCache;
+
+	Result cacheModule(const fs::path& /*moduleName*/, llvm::Module& /*compiledModule*/,
+	                   boost::string_view /*cacheKey*/) override {
+		return {};
+	}
+	void invalidateCache(const fs::path& /*moduleName*/) override {}
+	std::unique_ptr<llvm::Module> retrieveFromCache(const fs::path& /*moduleName*/,
+	                                                boost::string_view /*cacheKey*/) override {
+		return nullptr;
+	}
+};
+
+// The state of one compileModule call with LinkDependencies. Every module in the dependency
+// closure is compiled exactly once into `compiled`, and then they are all linked together once.
+struct CompileSession {
+	// `compiled[idx]` is the compiled `order[idx]`
+	std::vector<ChiModule*>                    order;
+	std::vector<std::unique_ptr<llvm::Module>> compiled;
+
+	std::unordered_map<ChiModule*, std::string> cacheKeys;
+
+	// the functions that can be called, only with LinkDependencies
+	ReachableFunctions reachable;
+
+	// the functions to generate in `mod`, or nullptr for all of them
+	const std::unordered_set<std::string>* functionsToGenerate(ChiModule& mod) const {
+		auto iter = reachable.find(&mod);
+		return iter == reachable.end() ? nullptr : &iter->second;
+	}
+
+	// if `mod` is a GraphModule that nothing calls into, so it doesn't need to be generated
+	bool unreachable(ChiModule& mod) const {
+		return dynamic_cast<GraphModule*>(&mod) != nullptr &&
+		       reachable.find(&mod) == reachable.end();
+	}
+};
+
+// A module to be generated on a worker thread
+struct IsolatedCompileJob {
+	// index of the module in the session order
+	size_t orderIdx;
+
+	// the settings that change code generation
+	Flags<CompileSettings> settings;
+
+	// the functions to generate, or nullptr for all of them
+	const std::unordered_set<std::string>* functions = nullptr;
+
+	// the serialized modules to load, dependencies first and the module to compile last
+	std::vector<std::pair<fs::path, nlohmann::json>> modules;
+
+	Result      res;
+	std::string bitcode;
+};
+
+// Load the modules in `job` into a new Context and generate the last one as bitcode. Nothing is
+// shared with the calling thread, so this is safe to run on any thread.
+void runIsolatedCompileJob(const fs::path& workspacePath, IsolatedCompileJob& job) {
+	Context isolated{workspacePath};
+	isolated.setModuleCache(std::make_unique<NullModuleCache>(isolated));
+
+	for (const auto& mod : job.modules) {
+		job.res += isolated.addModuleFromJson(mod.first, mod.second);
+		if (!job.res) { return; }
+	}
+
+	std::unique_ptr<llvm::Module> llmod;
+	job.res += compileSingleModule(isolated, *isolated.moduleByFullName(job.modules.back().first),
+	                               job.settings, "", job.functions, &llmod);
+	if (!job.res) { return; }
+
+	llvm::raw_string_ostream stream{job.bitcode};
+	llvm::WriteBitcodeToFile(llmod.get(), stream);
+	stream.flush();
+}
+
+// Fill `session.compiled`, generating cache misses on worker threads. See
+// CompileSettings::Parallel
+Result compileSessionParallel(Context& ctx, CompileSession& session,
+                              Flags<CompileSettings> settings) {
+	Result res;
+
+	auto& order    = session.order;
+	auto& compiled = session.compiled;
+
+	// the transitive dependencies of each module, including itself
+	std::unordered_map<ChiModule*, std::unordered_set<ChiModule*>> closures;
+	for (auto dep : order) {
+		auto& closure = closures[dep];
+		closure.insert(dep);
+		for (const auto& depName : dep->dependencies()) {
+			const auto& depClosure = closures[ctx.moduleByFullName(depName)];
+			closure.insert(depClosure.begin(), depClosure.end());
+		}
+	}
+
+	std::vector<IsolatedCompileJob>                jobs;
+	std::unordered_map<ChiModule*, nlohmann::json> serialized;
+
+	for (auto idx = 0ull; idx < order.size(); ++idx) {
+		auto& dep = *order[idx];
+
+		if (session.unreachable(dep)) { continue; }
+
+		if (settings & CompileSettings::UseCache) {
+			compiled[idx] =
+			    ctx.moduleCache().retrieveFromCache(dep.fullNamePath(), session.cacheKeys[&dep]);
+			if (compiled[idx]) { continue; }
+		}
+
+		// only GraphModules can be recreated in another Context, and only if everything they
+		// depend on can be too
+		IsolatedCompileJob job;
+		job.orderIdx      = idx;
+		job.settings      = settings & codegenSettings();
+		job.functions     = session.functionsToGenerate(dep);
+		bool transferable = true;
+		for (auto closureIdx = 0ull; closureIdx <= idx; ++closureIdx) {
+			auto closureMod = order[closureIdx];
+			if (closures[&dep].find(closureMod) == closures[&dep].end() ||
+			    closureMod == ctx.langModule()) {
+				continue;
+			}
+
+			auto graphMod = dynamic_cast<GraphModule*>(closureMod);
+			if (graphMod == nullptr) {
+				transferable = false;
+				break;
+			}
+
+			auto jsonIter = serialized.find(graphMod);
+			if (jsonIter == serialized.end()) {
+				jsonIter = serialized.emplace(graphMod, graphModuleToJson(*graphMod)).first;
+			}
+			job.modules.emplace_back(graphMod->fullNamePath(), jsonIter->second);
+		}
+
+		if (transferable) {
+			jobs.push_back(std::move(job));
+			continue;
+		}
+
+		res += compileSingleModule(ctx, dep, settings & codegenSettings(), session.cacheKeys[&dep],
+		                           session.functionsToGenerate(dep), &compiled[idx]);
+		if (!res) { return res; }
+	}
+
+	auto workspacePath = ctx.workspacePath();
+	parallelFor(jobs.size(), defaultJobCount(),
+	            [&](size_t jobIdx) { runIsolatedCompileJob(workspacePath, jobs[jobIdx]); });
+
+	// bring the results back into this context, in order
+	for (auto& job : jobs) {
+		res += job.res;
+		if (!res) { return res; }
+
+		auto& dep = *order[job.orderIdx];
+
+		res += parseBitcodeString(job.bitcode, ctx.llvmContext(), &compiled[job.orderIdx]);
+		if (!res) { return res; }
+
+		res += ctx.moduleCache().cacheModule(dep.fullNamePath(), *compiled[job.orderIdx],
+		                                     session.cacheKeys[&dep]);
+	}
+
+	return res;
+}
+
+#if LLVM_VERSION_AT_LEAST(3, 8)
+// Change the type of `subprogram`, made by FunctionCompiler, to match a function that
+// returnOutputsByValue rewrote to return `returnTy`. The exec output and the data outputs, which
+// are the last parameters, become the members of the returned struct, named `memberNames`.
+void returnOutputsByValueInDebugInfo(llvm::DISubprogram& subprogram, const llvm::DataLayout& layout,
+                                     llvm::StructType*               returnTy,
+                                     const std::vector<std::string>& memberNames) {
+	auto oldType = subprogram.getType();
+	if (oldType == nullptr) { return; }
+
+	auto& llctx     = subprogram.getContext();
+	auto  typeArray = oldType->getTypeArray();
+	// the return type, then the parameters, with the outputs last
+	auto firstOutputType = typeArray.size() - (returnTy->getNumElements() - 1);
+
+	std::vector<llvm::Metadata*> members;
+	auto                         structLayout = layout.getStructLayout(returnTy);
+	for (auto idx = 0u; idx < returnTy->getNumElements(); ++idx) {
+		auto memberType = idx == 0 ? typeArray[0] : typeArray[firstOutputType + idx - 1];
+		members.push_back(llvm::DIDerivedType::get(
+		    llctx, llvm::dwarf::DW_TAG_member,
+#if LLVM_VERSION_LESS_EQUAL(3, 8)
+		    llvm::MDString::get(llctx, memberNames[idx]),
+#else
+		    memberNames[idx],
+#endif
+		    nullptr, 0, nullptr, memberType,
+		    layout.getTypeSizeInBits(returnTy->getElementType(idx)), 8,
+		    structLayout->getElementOffsetInBits(idx),
+#if LLVM_VERSION_AT_LEAST(5, 0)
+		    llvm::None,
+#endif
+		    llvm::DINode::DIFlags{}, nullptr));
+	}
+	auto structType = llvm::DICompositeType::get(
+	    llctx, llvm::dwarf::DW_TAG_structure_type, "", nullptr, 0, nullptr, nullptr,
+	    structLayout->getSizeInBits(), 8, 0, llvm::DINode::DIFlags{},
+	    llvm::MDTuple::get(llctx, members), 0, nullptr, {}, "");
+
+	std::vector<llvm::Metadata*> types{structType};
+	for (auto idx = 1ull; idx < firstOutputType; ++idx) { types.push_back(typeArray[idx]); }
+	auto newType = llvm::DISubroutineType::get(llctx, oldType->getFlags(),
+#if LLVM_VERSION_AT_LEAST(4, 0)
+	                                           oldType->getCC(),
 #endif
-			                          );
+	                                           llvm::MDTuple::get(llctx, types));
+
+	for (auto idx = 0u; idx < subprogram.getNumOperands(); ++idx) {
+		if (subprogram.getOperand(idx).get() == oldType) {
+			subprogram.replaceOperandWith(idx, newType);
+			break;
+		}
+	}
+}
+#endif
+
+// If every output of `func` is a scalar, replace it with a function that returns its exec output
+// and data outputs in a struct instead of storing the outputs through the pointer arguments
+// starting at `firstOutput`, and rewrite `calls`, which must be every use of `func`, to store the
+// returned outputs where they used to be stored. The outputs don't have to go through memory
+// anymore, which makes calls cheaper, and tail calls possible. Returns false if `func` wasn't
+// changed.
+bool returnOutputsByValue(llvm::Function& func, size_t firstOutput,
+                          const std::vector<llvm::CallInst*>& calls) {
+	auto& llctx = func.getContext();
+
+	std::vector<llvm::Type*>  returnTypes{func.getReturnType()};
+	std::vector<std::string> memberNames{"exec_output"};
+	for (auto argIter = func.arg_begin(); argIter != func.arg_end(); ++argIter) {
+		if (argIter->getArgNo() < firstOutput) { continue; }
+
+		auto outputTy = argIter->getType()->getPointerElementType();
+		if (!outputTy->isIntegerTy() && !outputTy->isFloatingPointTy() &&
+		    !outputTy->isPointerTy()) {
+			return false;
+		}
+		returnTypes.push_back(outputTy);
+		memberNames.push_back(argIter->getName().str());
+	}
+	if (returnTypes.size() == 1) { return false; }
+
+	auto returnTy = llvm::StructType::get(llctx, returnTypes);
+
+	std::vector<llvm::Type*> paramTypes;
+	for (auto idx = 0ull; idx < firstOutput; ++idx) {
+		paramTypes.push_back(func.getFunctionType()->getParamType(idx));
+	}
+
+	// put it where `func` is, so the functions in the module stay in the same order
+	auto newFunc = llvm::Function::Create(llvm::FunctionType::get(returnTy, paramTypes, false),
+	                                      func.getLinkage(), "");
+#if LLVM_VERSION_AT_LEAST(3, 8)
+	func.getParent()->getFunctionList().insert(func.getIterator(), newFunc);
 #else
-			llvm::Linker::linkModules(*llmod, std::move(compiledDep));
+	func.getParent()->getFunctionList().insert(&func, newFunc);
 #endif
+	newFunc->takeName(&func);
+	newFunc->setCallingConv(func.getCallingConv());
+	// the parameters that are kept don't move, and the outputs don't have any attributes
+	newFunc->setAttributes(func.getAttributes());
+#if LLVM_VERSION_AT_LEAST(3, 8)
+	auto subprogram = func.getSubprogram();
+	func.setSubprogram(nullptr);
+	if (subprogram != nullptr) {
+		returnOutputsByValueInDebugInfo(*subprogram, func.getParent()->getDataLayout(), returnTy,
+		                                memberNames);
+	}
+	newFunc->setSubprogram(subprogram);
+#endif
+
+	newFunc->getBasicBlockList().splice(newFunc->begin(), func.getBasicBlockList());
+
+	// the outputs are stored to allocas instead, which are loaded when returning
+	llvm::IRBuilder<> builder{&newFunc->getEntryBlock(), newFunc->getEntryBlock().begin()};
+	std::vector<llvm::Value*> outputSlots;
+	auto                      newArgIter = newFunc->arg_begin();
+	for (auto argIter = func.arg_begin(); argIter != func.arg_end(); ++argIter) {
+		if (argIter->getArgNo() < firstOutput) {
+			argIter->replaceAllUsesWith(&*newArgIter);
+			newArgIter->takeName(&*argIter);
+			++newArgIter;
+			continue;
+		}
+
+		auto slot = builder.CreateAlloca(argIter->getType()->getPointerElementType());
+		slot->takeName(&*argIter);
+		argIter->replaceAllUsesWith(slot);
+		outputSlots.push_back(slot);
+	}
+
+	std::vector<llvm::ReturnInst*> returns;
+	for (auto& block : *newFunc) {
+		if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator())) {
+			returns.push_back(ret);
+		}
+	}
+	for (auto ret : returns) {
+		builder.SetInsertPoint(ret);
+
+		llvm::Value* returned = llvm::UndefValue::get(returnTy);
+		returned              = builder.CreateInsertValue(returned, ret->getReturnValue(), 0);
+		for (auto idx = 0u; idx < outputSlots.size(); ++idx) {
+			returned =
+			    builder.CreateInsertValue(returned, builder.CreateLoad(outputSlots[idx]), idx + 1);
 		}
+		builder.CreateRet(returned)->setDebugLoc(ret->getDebugLoc());
+		ret->eraseFromParent();
+	}
+
+	for (auto call : calls) {
+		builder.SetInsertPoint(call);
+		builder.SetCurrentDebugLocation(call->getDebugLoc());
 
-		// link in runtime if this is a main module
-		if (mod.shortName() == "main") {
-			// find the runtime
-			auto runtimebc =
-			    executablePath().parent_path().parent_path() / "lib" / "chigraph" / "runtime.bc";
+		std::vector<llvm::Value*> args;
+		for (auto idx = 0ull; idx < firstOutput; ++idx) {
+			args.push_back(call->getArgOperand(idx));
+		}
+
+		auto newCall = builder.CreateCall(newFunc, args);
+		newCall->setCallingConv(call->getCallingConv());
+
+		for (auto idx = 0u; idx < outputSlots.size(); ++idx) {
+			builder.CreateStore(builder.CreateExtractValue(newCall, idx + 1),
+			                    call->getArgOperand(firstOutput + idx));
+		}
+		call->replaceAllUsesWith(builder.CreateExtractValue(newCall, 0));
+		call->eraseFromParent();
+	}
 
-			// just in case the executable is in a "Debug" folder or something
-			if (!fs::is_regular_file(runtimebc)) {
-				runtimebc = executablePath().parent_path().parent_path().parent_path() / "lib" / "chigraph" / "runtime.bc";
+	func.eraseFromParent();
+
+	return true;
+}
+
+// Check if `call`, a direct call, passes a separate alloca for each argument from `firstOutput`
+// on, that isn't passed as any other argument either
+bool outputsAreSeparateAllocas(const llvm::CallInst& call, size_t firstOutput) {
+	std::unordered_set<const llvm::Value*> args;
+	for (auto idx = 0u; idx < firstOutput; ++idx) {
+		args.insert(call.getArgOperand(idx)->stripPointerCasts());
+	}
+	for (auto idx = firstOutput; idx < call.getCalledFunction()->arg_size(); ++idx) {
+		auto output = call.getArgOperand(idx)->stripPointerCasts();
+		if (!llvm::isa<llvm::AllocaInst>(output) || !args.insert(output).second) { return false; }
+	}
+	return true;
+}
+
+// Give every generated graph function that isn't in `root` internal linkage, as nothing outside
+// of `llmod` can call it. Those that are only called directly use the fast calling convention and
+// return their outputs by value (see returnOutputsByValue) when they can. If they can't, and every
+// call passes separate allocas for the outputs, the output pointers are marked `noalias` and
+// `nocapture`. The functions in `root` are the entry points and are left alone.
+void internalizeDependencies(llvm::Module& llmod, const CompileSession& session,
+                             const ChiModule& root) {
+	// go in a fixed order, so the same module always comes out the same
+	for (auto dep : session.order) {
+		if (dep == &root) { continue; }
+
+		auto graphMod  = dynamic_cast<GraphModule*>(dep);
+		auto functions = session.functionsToGenerate(*dep);
+		if (graphMod == nullptr || functions == nullptr) { continue; }
+
+		std::set<std::string> sortedFunctions(functions->begin(), functions->end());
+		for (const auto& name : sortedFunctions) {
+			auto graphFunc = graphMod->functionFromName(name);
+			auto llfunc    = llmod.getFunction(mangleFunctionName(graphMod->fullName(), name));
+			// functions that were never referenced weren't linked in
+			if (graphFunc == nullptr || llfunc == nullptr || llfunc->isDeclaration()) { continue; }
+
+			llfunc->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+			// the first argument is the input exec ID, then the data inputs, then the outputs
+			auto firstOutput = 1 + graphFunc->dataInputs().size();
+
+			// the calling convention of the calls has to match, so only change it if every use is
+			// a direct call
+			std::vector<llvm::CallInst*> calls;
+			auto                         onlyCalled = true;
+			for (auto user : llfunc->users()) {
+				auto call = llvm::dyn_cast<llvm::CallInst>(user);
+				if (call == nullptr || call->getCalledFunction() != llfunc) {
+					onlyCalled = false;
+					break;
+				}
+				calls.push_back(call);
 			}
+			// if the address escapes, nothing is known about the calls through it
+			if (!onlyCalled) { continue; }
+
+			llfunc->setCallingConv(llvm::CallingConv::Fast);
+			for (auto call : calls) { call->setCallingConv(llvm::CallingConv::Fast); }
 
-			if (!fs::is_regular_file(runtimebc)) {
-				res.addEntry(
-				    "EUKN", "Failed to find runtime.bc in lib/chigraph/runtime.bc",
-				    {{"Install prefix", executablePath().parent_path().parent_path().string()}});
+			if (returnOutputsByValue(*llfunc, firstOutput, calls)) { continue; }
+
+			// the callee only stores to the outputs, so they're `noalias` and `nocapture` as long
+			// as the callers don't pass the same memory twice
+			auto separateOutputs = [&](llvm::CallInst* call) {
+				return outputsAreSeparateAllocas(*call, firstOutput);
+			};
+			if (!std::all_of(calls.begin(), calls.end(), separateOutputs)) { continue; }
+
+			for (auto argNo = firstOutput; argNo < llfunc->arg_size(); ++argNo) {
+#if LLVM_VERSION_AT_LEAST(5, 0)
+				llfunc->addParamAttr(argNo, llvm::Attribute::NoAlias);
+				llfunc->addParamAttr(argNo, llvm::Attribute::NoCapture);
+#else
+				llfunc->addAttribute(argNo + 1, llvm::Attribute::NoAlias);
+				llfunc->addAttribute(argNo + 1, llvm::Attribute::NoCapture);
+#endif
 			}
+		}
+	}
+}
+
+}  // anonymous namespace
+
+Result Context::compileModule(const boost::filesystem::path& fullName,
+                              Flags<CompileSettings>         settings,
+                              std::unique_ptr<llvm::Module>* toFill) {
+	Result res;
+
+	auto mod = moduleByFullName(fullName);
+	if (mod == nullptr) {
+		res.addEntry("E36", "Could not find module", {{"module", fullName.generic_string()}});
+		return res;
+	}
+
+	return compileModule(*mod, settings, toFill);
+}
+
+Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
+                              std::unique_ptr<llvm::Module>* toFill) {
+	assert(toFill != nullptr);
+
+	Result res;
+
+	auto modNameCtx = res.addScopedContext({{"Module Name", mod.fullName()}});
+
+	// find every module that needs to be compiled, each only once and dependencies first
+	CompileSession session;
+	res += dependencyOrder(*this, mod, &session.order);
+	if (!res) { return res; }
 
-			// load the BC file
-			std::unique_ptr<llvm::Module> runtimeMod;
-			res += parseBitcodeFile(runtimebc, llvmContext(), &runtimeMod);
+	// when linking, only what can be called from `mod` needs to be generated
+	if (settings & CompileSettings::LinkDependencies) {
+		session.reachable = reachableFunctions(mod);
+	}
+
+	session.cacheKeys = moduleCacheKeys(*this, session.order, settings, session.reachable);
+
+	if (!(settings & CompileSettings::LinkDependencies)) {
+		res += compileSingleModule(*this, mod, settings, session.cacheKeys[&mod], nullptr, toFill);
+		if (!res) { return res; }
+
+		res += materializeModule(**toFill);
+		return res;
+	}
+
+	session.compiled.resize(session.order.size());
+
+	if (settings & CompileSettings::Parallel) {
+		res += compileSessionParallel(*this, session, settings);
+	} else {
+		for (auto idx = 0ull; idx < session.order.size(); ++idx) {
+			auto dep = session.order[idx];
+			if (session.unreachable(*dep)) { continue; }
+
+			res += compileSingleModule(*this, *dep, settings, session.cacheKeys[dep],
+			                           session.functionsToGenerate(*dep), &session.compiled[idx]);
 			if (!res) { return res; }
+		}
+	}
+	if (!res) { return res; }
 
-// link it in
-#if LLVM_VERSION_LESS_EQUAL(3, 7)
-			llvm::Linker::LinkModules(llmod.get(), runtimeMod.get()
-#if LLVM_VERSION_LESS_EQUAL(3, 5)
-			                                           ,
-			                          llvm::Linker::DestroySource, nullptr
-#endif
-			                          );
+	// `mod` is last in the order, link everything else into it. Modules from the cache are lazily
+	// loaded, so only `mod` is materialized fully. Dependencies are linked dependents first, so by
+	// the time a module is linked everything that uses it is already in, and only the functions
+	// that are actually referenced get read. GraphModules that nothing calls into weren't generated
+	// at all.
+	auto llmod = std::move(session.compiled.back());
+	res += materializeModule(*llmod);
+	if (!res) { return res; }
+
+	for (auto idx = session.order.size() - 1; idx-- > 0;) {
+		// unreachable modules weren't generated
+		if (session.compiled[idx] == nullptr) { continue; }
+
+		res += linkModule(*llmod, std::move(session.compiled[idx]), true);
+		if (!res) { return res; }
+	}
+
+	if (settings & CompileSettings::WholeProgram) { internalizeDependencies(*llmod, session, mod); }
+
+	// now that every definition is in, calls to functions marked always inline can be inlined.
+	// The inlined exec input switch is on a constant then, so fold it away, even at -O0. Only the
+	// functions that had calls inlined into them are touched
+	if (settings & CompileSettings::InlineFunctions) {
+		std::unordered_set<llvm::Function*> inlinedInto;
+		for (auto& callee : *llmod) {
+			if (callee.isDeclaration() || !callee.hasFnAttribute(llvm::Attribute::AlwaysInline)) {
+				continue;
+			}
+			for (auto user : callee.users()) {
+				auto call = llvm::dyn_cast<llvm::CallInst>(user);
+				if (call != nullptr && call->getCalledFunction() == &callee) {
+					inlinedInto.insert(call->getParent()->getParent());
+				}
+			}
+		}
+
+		llvm::legacy::PassManager inliner;
+#if LLVM_VERSION_LESS_EQUAL(3, 9)
+		inliner.add(llvm::createAlwaysInlinerPass());
 #else
-			llvm::Linker::linkModules(*llmod, std::move(runtimeMod));
+		inliner.add(llvm::createAlwaysInlinerLegacyPass());
 #endif
+		inliner.run(*llmod);
+
+		llvm::legacy::FunctionPassManager cleanup{llmod.get()};
+		cleanup.add(llvm::createSCCPPass());
+		cleanup.add(llvm::createCFGSimplificationPass());
+		cleanup.doInitialization();
+		// the inliner can remove functions that aren't called anymore, so only look at the ones
+		// that are still in the module
+		for (auto& func : *llmod) {
+			if (inlinedInto.count(&func) != 0) { cleanup.run(func); }
 		}
+		cleanup.doFinalization();
+	}
+
+	// link in runtime if this is a main module
+	if (mod.shortName() == "main") {
+		res += linkRuntime(*llmod);
+		if (!res) { return res; }
 	}
 
 	*toFill = std::move(llmod);
@@ -446,6 +1160,42 @@ Result Context::compileModule(ChiModule& mod, Flags<CompileSettings> settings,
 	return res;
 }
 
+Result Context::linkRuntime(llvm::Module& into) {
+	Result res;
+
+	if (mRuntimeModule == nullptr) {
+		// find the runtime
+		auto runtimebc =
+		    executablePath().parent_path().parent_path() / "lib" / "chigraph" / "runtime.bc";
+
+		// just in case the executable is in a "Debug" folder or something
+		if (!fs::is_regular_file(runtimebc)) {
+			runtimebc = executablePath().parent_path().parent_path().parent_path() / "lib" /
+			            "chigraph" / "runtime.bc";
+		}
+
+		if (!fs::is_regular_file(runtimebc)) {
+			res.addEntry(
+			    "EUKN", "Failed to find runtime.bc in lib/chigraph/runtime.bc",
+			    {{"Install prefix", executablePath().parent_path().parent_path().string()}});
+		}
+
+		// load the BC file
+		res += parseBitcodeFile(runtimebc, llvmContext(), &mRuntimeModule);
+		if (!res) {
+			mRuntimeModule = nullptr;
+			return res;
+		}
+	}
+
+	// linking consumes the module, so link a copy. The runtime's entry point isn't referenced by
+	// anything, so link all of it
+	auto runtimeCopy = std::unique_ptr<llvm::Module>(llvm::CloneModule(mRuntimeModule.get()));
+	res += linkModule(into, std::move(runtimeCopy));
+
+	return res;
+}
+
 std::vector<NodeInstance*> Context::findInstancesOfType(const fs::path&    moduleName,
                                                         boost::string_view typeName) const {
 	std::vector<NodeInstance*> ret;
@@ -491,6 +1241,7 @@ namespace {
 
 std::unique_ptr<llvm::ExecutionEngine> createEE(std::unique_ptr<llvm::Module> mod,
                                                 llvm::CodeGenOpt::Level       optLevel,
+                                                llvm::ObjectCache*            objectCache,
                                                 std::string&                  errMsg) {
 	llvm::InitializeNativeTarget();
 	llvm::InitializeNativeTargetAsmPrinter();
@@ -525,14 +1276,19 @@ std::unique_ptr<llvm::ExecutionEngine> createEE(std::unique_ptr<llvm::Module> mo
 #endif
 	    (new llvm::SectionMemoryManager()));
 
-	return std::unique_ptr<llvm::ExecutionEngine>(EEBuilder.create());
+	std::unique_ptr<llvm::ExecutionEngine> EE{EEBuilder.create()};
+
+	// this has to be set before anything is compiled
+	if (EE && objectCache != nullptr) { EE->setObjectCache(objectCache); }
+
+	return EE;
 }
 
 }  // anonymous namespace
 
 Result interpretLLVMIR(std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt::Level optLevel,
                        const std::vector<llvm::GenericValue>& args, llvm::Function* funcToRun,
-                       llvm::GenericValue* ret) {
+                       llvm::GenericValue* ret, llvm::ObjectCache* objectCache) {
 	assert(mod);
 
 	Result res;
@@ -548,15 +1304,15 @@ Result interpretLLVMIR(std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt::Leve
 	}
 
 	std::string errMsg;
-	auto        EE = createEE(std::move(mod), optLevel, errMsg);
-	EE->finalizeObject();
-	EE->runStaticConstructorsDestructors(false);
-
+	auto        EE = createEE(std::move(mod), optLevel, objectCache, errMsg);
 	if (!EE) {
 		res.addEntry("EINT", "Failed to create an LLVM ExecutionEngine", {{"Error", errMsg}});
 		return res;
 	}
 
+	EE->finalizeObject();
+	EE->runStaticConstructorsDestructors(false);
+
 	auto returnValue = EE->runFunction(funcToRun, args);
 
 	EE->runStaticConstructorsDestructors(true);
@@ -568,7 +1324,7 @@ Result interpretLLVMIR(std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt::Leve
 
 Result interpretLLVMIRAsMain(std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt::Level optLevel,
                              const std::vector<std::string>& args, llvm::Function* funcToRun,
-                             int* ret) {
+                             int* ret, llvm::ObjectCache* objectCache) {
 	assert(mod);
 
 	Result res;
@@ -584,15 +1340,15 @@ Result interpretLLVMIRAsMain(std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt
 	}
 
 	std::string errMsg;
-	auto        EE = createEE(std::move(mod), optLevel, errMsg);
-	EE->finalizeObject();
-	EE->runStaticConstructorsDestructors(false);
-
+	auto        EE = createEE(std::move(mod), optLevel, objectCache, errMsg);
 	if (!EE) {
 		res.addEntry("EINT", "Failed to create an LLVM ExecutionEngine", {{"Error", errMsg}});
 		return res;
 	}
 
+	EE->finalizeObject();
+	EE->runStaticConstructorsDestructors(false);
+
 	auto returnValue = EE->runFunctionAsMain(funcToRun, args, nullptr);
 
 	EE->runStaticConstructorsDestructors(true);
@@ -601,6 +1357,190 @@ Result interpretLLVMIRAsMain(std::unique_ptr<llvm::Module> mod, llvm::CodeGenOpt
 
 	return res;
 }
+
+#if LLVM_VERSION_AT_LEAST(5, 0)
+namespace {
+
+// A JIT that compiles each function the first time it's called. Calls to functions that haven't
+// been compiled yet go through stubs that call back into the JIT.
+struct LazyJIT {
+	using ObjectLayer  = llvm::orc::RTDyldObjectLinkingLayer;
+	using CompileLayer = llvm::orc::IRCompileLayer<ObjectLayer, llvm::orc::SimpleCompiler>;
+	using CODLayer     = llvm::orc::CompileOnDemandLayer<CompileLayer>;
+
+	explicit LazyJIT(std::unique_ptr<llvm::TargetMachine> targetMachine)
+	    : tm{std::move(targetMachine)},
+	      dataLayout{tm->createDataLayout()},
+	      objectLayer{[] { return std::make_shared<llvm::SectionMemoryManager>(); }},
+	      compileLayer{objectLayer, llvm::orc::SimpleCompiler(*tm)},
+	      callbackManager{
+	          llvm::orc::createLocalCompileCallbackManager(tm->getTargetTriple(), 0)},
+	      codLayer{compileLayer,
+	               // compile one function at a time
+	               [](llvm::Function& func) { return std::set<llvm::Function*>{&func}; },
+	               *callbackManager,
+	               llvm::orc::createLocalIndirectStubsManagerBuilder(tm->getTargetTriple())} {
+		// so the JITed code can call into libc and the runtime
+		llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+	}
+
+	Result addModule(std::unique_ptr<llvm::Module> mod) {
+		Result res;
+
+		mod->setDataLayout(dataLayout);
+
+		// look in the JIT first, and then in the process
+		auto resolver = llvm::orc::createLambdaResolver(
+		    [this](const std::string& name) {
+			    if (auto sym = codLayer.findSymbol(name, false)) { return sym; }
+			    return llvm::JITSymbol(nullptr);
+			},
+		    [](const std::string& name) {
+			    if (auto addr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name)) {
+				    return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+			    }
+			    return llvm::JITSymbol(nullptr);
+			});
+
+		auto handle = codLayer.addModule(std::move(mod), std::move(resolver));
+		if (!handle) {
+			res.addEntry("EINT", "Failed to add module to the lazy JIT",
+			             {{"Error", llvm::toString(handle.takeError())}});
+		}
+
+		return res;
+	}
+
+	// get the address of a function, compiling it if it hasn't been yet
+	Result functionAddress(llvm::StringRef name, llvm::JITTargetAddress* toFill) {
+		Result res;
+
+		std::string mangledName;
+		{
+			llvm::raw_string_ostream stream{mangledName};
+			llvm::Mangler::getNameWithPrefix(stream, name, dataLayout);
+		}
+
+		auto sym = codLayer.findSymbol(mangledName, false);
+		if (!sym) {
+			res.addEntry("EUKN", "Failed to find function in the lazy JIT",
+			             {{"Function", name.str()}});
+			return res;
+		}
+
+		auto addr = sym.getAddress();
+		if (!addr) {
+			res.addEntry("EINT", "Failed to compile function",
+			             {{"Function", name.str()}, {"Error", llvm::toString(addr.takeError())}});
+			return res;
+		}
+
+		*toFill = *addr;
+		return res;
+	}
+
+	std::unique_ptr<llvm::TargetMachine>                 tm;
+	const llvm::DataLayout                               dataLayout;
+	ObjectLayer                                          objectLayer;
+	CompileLayer                                         compileLayer;
+	std::unique_ptr<llvm::orc::JITCompileCallbackManager> callbackManager;
+	CODLayer                                             codLayer;
+};
+
+}  // anonymous namespace
+#endif
+
+Result interpretLLVMIRAsMainLazily(std::unique_ptr<llvm::Module> mod,
+                                   llvm::CodeGenOpt::Level optLevel,
+                                   const std::vector<std::string>& args, llvm::Function* funcToRun,
+                                   int* ret) {
+	assert(mod);
+
+	Result res;
+
+#if LLVM_VERSION_LESS_EQUAL(4, 0)
+	// the ORC layers this needs were only added in 5.0
+	res.addEntry("EUKN", "Lazy compilation needs LLVM 5.0 or newer",
+	             {{"LLVM Version", LLVM_VERSION_STRING}});
+	return res;
+#else
+
+	if (funcToRun == nullptr) {
+		funcToRun = mod->getFunction("main");
+
+		if (funcToRun == nullptr) {
+			res.addEntry("EUKN", "Failed to find main function in module",
+			             {{"Module Name", mod->getModuleIdentifier()}});
+			return res;
+		}
+	}
+
+	// the module is gone once it's in the JIT, so get everything we need from it now
+	auto funcName  = funcToRun->getName().str();
+	auto numParams = funcToRun->getFunctionType()->getNumParams();
+
+	std::vector<std::string> ctorNames, dtorNames;
+	for (const auto& ctor : llvm::orc::getConstructors(*mod)) {
+		ctorNames.push_back(ctor.Func->getName().str());
+	}
+	for (const auto& dtor : llvm::orc::getDestructors(*mod)) {
+		dtorNames.push_back(dtor.Func->getName().str());
+	}
+
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+	llvm::InitializeNativeTargetAsmParser();
+
+	std::unique_ptr<llvm::TargetMachine> tm{
+	    llvm::EngineBuilder().setOptLevel(optLevel).selectTarget()};
+	if (tm == nullptr) {
+		res.addEntry("EINT", "Failed to create a TargetMachine for the host", {});
+		return res;
+	}
+
+	LazyJIT jit{std::move(tm)};
+	res += jit.addModule(std::move(mod));
+	if (!res) { return res; }
+
+	auto runAll = [&](const std::vector<std::string>& names) {
+		for (const auto& name : names) {
+			llvm::JITTargetAddress addr = 0;
+			res += jit.functionAddress(name, &addr);
+			if (!res) { return; }
+
+			reinterpret_cast<void (*)()>(static_cast<uintptr_t>(addr))();
+		}
+	};
+
+	runAll(ctorNames);
+	if (!res) { return res; }
+
+	llvm::JITTargetAddress mainAddr = 0;
+	res += jit.functionAddress(funcName, &mainAddr);
+	if (!res) { return res; }
+
+	// build a null terminated argv
+	std::vector<std::string> argStorage = args;
+	std::vector<char*>       argv;
+	for (auto& arg : argStorage) { argv.push_back(&arg[0]); }
+	argv.push_back(nullptr);
+
+	int returnValue;
+	if (numParams == 0) {
+		returnValue = reinterpret_cast<int (*)()>(static_cast<uintptr_t>(mainAddr))();
+	} else {
+		returnValue = reinterpret_cast<int (*)(int, char**)>(static_cast<uintptr_t>(mainAddr))(
+		    int(args.size()), argv.data());
+	}
+
+	runAll(dtorNames);
+
+	if (ret != nullptr) { *ret = returnValue; }
+
+	return res;
+#endif
+}
+
 void Context::setModuleCache(std::unique_ptr<ModuleCache> newCache) {
 	assert(newCache != nullptr && "Cannot set the modulecache to be nullptr");
 
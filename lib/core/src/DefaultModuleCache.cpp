@@ -7,9 +7,12 @@
 #include "chi/ModuleCache.hpp"
 #include "chi/Support/Result.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <ctime>
 
 #include <boost/filesystem/operations.hpp>
+#include <boost/range/iterator_range.hpp>
 
 #if LLVM_VERSION_LESS_EQUAL(3, 9)
 #include <llvm/Bitcode/ReaderWriter.h>
@@ -21,21 +24,54 @@
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_ostream.h>
 
+namespace fs = boost::filesystem;
+
 namespace chi {
 
 DefaultModuleCache::DefaultModuleCache(chi::Context& ctx) : ModuleCache{ctx} {}
 
-Result DefaultModuleCache::cacheModule(const boost::filesystem::path& moduleName,
-                                       llvm::Module& compiledModule, std::time_t timeAtFileRead) {
+constexpr size_t DefaultModuleCache::maxVersionsPerModule;
+
+namespace {
+
+// get the cached versions of a module, most recently used first
+std::vector<fs::path> cachedVersions(const fs::path& cacheDir) {
+	std::vector<std::pair<std::time_t, fs::path>> versions;
+
+	if (!fs::is_directory(cacheDir)) { return {}; }
+
+	for (const auto& entry : boost::make_iterator_range(fs::directory_iterator{cacheDir}, {})) {
+		if (fs::is_regular_file(entry.path()) && entry.path().extension() == ".bc") {
+			versions.emplace_back(fs::last_write_time(entry.path()), entry.path());
+		}
+	}
+
+	std::sort(versions.begin(), versions.end(),
+	          [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+	std::vector<fs::path> ret;
+	for (auto& version : versions) { ret.push_back(std::move(version.second)); }
+	return ret;
+}
+
+}  // anonymous namespace
+
+Result DefaultModuleCache::cacheModule(const fs::path& moduleName, llvm::Module& compiledModule,
+                                       boost::string_view cacheKey) {
 	assert(!moduleName.empty() &&
 	       "Cannot pass a empty module name to DefaultModuleCache::cacheModule");
 
 	Result res;
 
-	auto cachePath = cachePathForModule(moduleName);
+	auto cachePath = cachePathForModule(moduleName, cacheKey);
 
 	// make the directories
-	boost::filesystem::create_directories(cachePath.parent_path());
+	fs::create_directories(cachePath.parent_path());
+
+	// write to a temporary file first, so nobody reads a half written cache. It has a unique name
+	// so other threads or processes caching the same version don't write over it
+	auto tmpPath = cachePath;
+	tmpPath += "." + fs::unique_path().string() + ".tmp";
 
 	// open & write
 	{
@@ -43,7 +79,7 @@ Result DefaultModuleCache::cacheModule(const boost::filesystem::path& moduleName
 		std::error_code      errCode;
 		std::string          errString;
 		llvm::raw_fd_ostream fileStream {
-			cachePath.string().c_str(),
+			tmpPath.string().c_str(),
 #if LLVM_VERSION_LESS_EQUAL(3, 5)
 			    errString,
 #else
@@ -53,7 +89,7 @@ Result DefaultModuleCache::cacheModule(const boost::filesystem::path& moduleName
 		};
 
 		if (errCode || !errString.empty()) {
-			res.addEntry("EUKN", "Failed to open file", {{"Path", cachePath.string()}});
+			res.addEntry("EUKN", "Failed to open file", {{"Path", tmpPath.string()}});
 			return res;
 		}
 
@@ -61,49 +97,75 @@ Result DefaultModuleCache::cacheModule(const boost::filesystem::path& moduleName
 		llvm::WriteBitcodeToFile(&compiledModule, fileStream);
 	}
 
-	// set age to be correct
-	boost::filesystem::last_write_time(cachePath, timeAtFileRead);
+	boost::system::error_code renameErr;
+	fs::rename(tmpPath, cachePath, renameErr);
+	if (renameErr) {
+		boost::system::error_code ec;
+		fs::remove(tmpPath, ec);
+
+		res.addEntry("EUKN", "Failed to move cache file into place",
+		             {{"Path", cachePath.string()}, {"Error", renameErr.message()}});
+		return res;
+	}
+
+	// remove the least recently used versions, and the cache from before modules had versions
+	auto versions = cachedVersions(cachePath.parent_path());
+	for (auto idx = maxVersionsPerModule; idx < versions.size(); ++idx) {
+		boost::system::error_code ec;
+		fs::remove(versions[idx], ec);
+	}
+	removeUnversionedCache(moduleName);
 
 	return res;
 }
 
-boost::filesystem::path DefaultModuleCache::cachePathForModule(
-    const boost::filesystem::path& moduleName) const {
-	return context().workspacePath() / "lib" / (moduleName.string() + ".bc");
-}
+void DefaultModuleCache::removeUnversionedCache(const fs::path& moduleName) const {
+	auto oldPath = cacheDirForModule(moduleName);
+	oldPath += ".bc";
 
-void DefaultModuleCache::invalidateCache(const boost::filesystem::path& moduleName) {
-	assert(!moduleName.empty() && "Cannot pass empty path to DefaultModuleCache::invalidateCache");
+	boost::system::error_code ec;
+	fs::remove(oldPath, ec);
+}
 
-	auto cachePath = cachePathForModule(moduleName);
+fs::path DefaultModuleCache::cacheDirForModule(const fs::path& moduleName) const {
+	return context().workspacePath() / "lib" / moduleName;
+}
 
-	boost::filesystem::remove(cachePath);
+fs::path DefaultModuleCache::cachePathForModule(const fs::path&    moduleName,
+                                                boost::string_view cacheKey) const {
+	return cacheDirForModule(moduleName) / (cacheKey.to_string() + ".bc");
 }
 
-std::time_t DefaultModuleCache::cacheUpdateTime(const boost::filesystem::path& moduleName) const {
-	return boost::filesystem::last_write_time(cachePathForModule(moduleName));
+void DefaultModuleCache::invalidateCache(const fs::path& moduleName) {
+	assert(!moduleName.empty() && "Cannot pass empty path to DefaultModuleCache::invalidateCache");
+
+	for (const auto& version : cachedVersions(cacheDirForModule(moduleName))) {
+		boost::system::error_code ec;
+		fs::remove(version, ec);
+	}
+	removeUnversionedCache(moduleName);
 }
 
-std::unique_ptr<llvm::Module> DefaultModuleCache::retrieveFromCache(
-    const boost::filesystem::path& moduleName, std::time_t atLeastThisNew) {
+std::unique_ptr<llvm::Module> DefaultModuleCache::retrieveFromCache(const fs::path&    moduleName,
+                                                                    boost::string_view cacheKey) {
 	assert(!moduleName.empty() &&
 	       "Cannot pass empty path to DefaultModuleCache::retrieveFromCache");
 
-	auto cachePath = cachePathForModule(moduleName);
+	auto cachePath = cachePathForModule(moduleName, cacheKey);
 
 	// if there is no cache, then there is nothing to retrieve
-	if (!boost::filesystem::is_regular_file(cachePath)) { return nullptr; }
-
-	// see if the cache is new enough
-	auto cacheEditTime = cacheUpdateTime(moduleName);
-	if (cacheEditTime < atLeastThisNew) { return nullptr; }
+	if (!fs::is_regular_file(cachePath)) { return nullptr; }
 
-	// read the cache
+	// map the cache, function bodies are read when the linker or JIT asks for them
 	std::unique_ptr<llvm::Module> fetchedMod;
-	auto res = parseBitcodeFile(cachePath, context().llvmContext(), &fetchedMod);
+	auto res = parseBitcodeFileLazy(cachePath, context().llvmContext(), &fetchedMod);
 
 	if (!res) { return nullptr; }
 
+	// mark it as used so it isn't pruned
+	boost::system::error_code ec;
+	fs::last_write_time(cachePath, std::time(nullptr), ec);
+
 	return fetchedMod;
 }
 
@@ -18,19 +18,47 @@
 #include <boost/range/join.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+#include <algorithm>
+#include <iterator>
 #include <unordered_map>
 
 #include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/Dominators.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
 
 namespace fs = boost::filesystem;
 
 namespace chi {
 
+namespace {
+
+// Check if a function should be inlined with InlinePolicy::Auto: it's small, and it doesn't call
+// any graph functions, so inlining it can't recurse or blow up the caller
+bool smallLeafFunction(const GraphFunction& func) {
+	if (func.nodes().size() > smallFunctionNodeCount) { return false; }
+
+	for (const auto& node : func.nodes()) {
+		auto graphModule = dynamic_cast<GraphModule*>(&node.second->type().module());
+		if (graphModule != nullptr &&
+		    graphModule->functionFromName(node.second->type().name()) != nullptr) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}  // anonymous namespace
+
 FunctionCompiler::FunctionCompiler(const chi::GraphFunction& func, llvm::Module& moduleToGenInto,
-                                   llvm::DICompileUnit& debugCU, llvm::DIBuilder& debugBuilder)
-    : mModule{&moduleToGenInto}, mDIBuilder{&debugBuilder}, mDebugCU{&debugCU}, mFunction{&func} {}
+                                   llvm::DICompileUnit& debugCU, llvm::DIBuilder& debugBuilder,
+                                   Flags<CompileSettings> settings)
+    : mModule{&moduleToGenInto},
+      mDIBuilder{&debugBuilder},
+      mDebugCU{&debugCU},
+      mFunction{&func},
+      mSettings{settings} {}
 
 Result FunctionCompiler::initialize(bool validate) {
 	assert(initialized() == false && "Cannot initialize a FunctionCompiler more than once");
@@ -58,6 +86,20 @@ Result FunctionCompiler::initialize(bool validate) {
 	mLLFunction      = llvm::cast<llvm::Function>(
 	    llvmModule().getOrInsertFunction(mangledName, function().functionType()));
 
+	// mark it for the inliner, which runs after linking with CompileSettings::InlineFunctions.
+	// Without it, the function is left for the optimizer to decide
+	if (settings() & CompileSettings::InlineFunctions) {
+		switch (function().inlinePolicy()) {
+		case InlinePolicy::Always: mLLFunction->addFnAttr(llvm::Attribute::AlwaysInline); break;
+		case InlinePolicy::Never: mLLFunction->addFnAttr(llvm::Attribute::NoInline); break;
+		case InlinePolicy::Auto:
+			if (smallLeafFunction(function())) {
+				mLLFunction->addFnAttr(llvm::Attribute::AlwaysInline);
+			}
+			break;
+		}
+	}
+
 	// create the debug file
 	mDIFile = diBuilder().createFile(debugCompileUnit()->getFilename(),
 	                                 debugCompileUnit()->getDirectory());
@@ -179,12 +221,8 @@ Result FunctionCompiler::initialize(bool validate) {
 		++idx;
 	}
 
-	// create mPostPureBreak
-	llvm::IRBuilder<> allocBuilder{&allocBlock()};
-	mPostPureBreak = allocBuilder.CreateAlloca(
-	    llvm::IntegerType::getInt8PtrTy(context().llvmContext()), nullptr, "pure_jumpback");
-
 	// alloc local variables and zero them
+	llvm::IRBuilder<> allocBuilder{&allocBlock()};
 	for (const auto& localVar : function().localVariables()) {
 		mLocalVariables[localVar.name] =
 		    allocBuilder.CreateAlloca(localVar.type.llvmType(), nullptr, "var_" + localVar.name);
@@ -208,19 +246,6 @@ Result FunctionCompiler::compile() {
 
 	Result res;
 
-	auto compilePureDependencies = [this](NodeInstance& node) {
-		Result res;
-
-		auto depPures = dependentPuresRecursive(node);
-		for (auto pure : depPures) {
-			auto compiler = getOrCreateNodeCompiler(*pure);
-			res += compiler->compile_stage2({}, 0);
-
-			if (!res) { return res; }
-		}
-		return res;
-	};
-
 	while (!nodesToCompile.empty()) {
 		auto& node        = *nodesToCompile[0].first;
 		auto  inputExecID = nodesToCompile[0].second;
@@ -234,16 +259,9 @@ Result FunctionCompiler::compile() {
 			continue;
 		}
 
-		// compile dependent pures
-		res += compilePureDependencies(node);
-		if (!res) { return res; }
-
 		std::vector<llvm::BasicBlock*> outputBlocks;
 		// make sure the output nodes have done stage 1 and collect output blocks
 		for (const auto& conn : node.outputExecConnections) {
-			res += compilePureDependencies(*conn.first);
-			if (!res) { return res; }
-
 			auto depCompiler = getOrCreateNodeCompiler(*conn.first);
 			depCompiler->compile_stage1(conn.second);
 
@@ -269,6 +287,22 @@ Result FunctionCompiler::compile() {
 	llvm::IRBuilder<> allocBuilder{&allocBlock()};
 	allocBuilder.CreateBr(&nodeCompiler(*entry)->firstBlock(0));
 
+	// now that every block is there, node outputs that are only loaded from and stored to can be
+	// turned into SSA values
+	if (settings() & CompileSettings::SSAOutputs) {
+		std::vector<llvm::AllocaInst*> promotable;
+		std::copy_if(mAllocasToPromote.begin(), mAllocasToPromote.end(),
+		             std::back_inserter(promotable),
+		             [](llvm::AllocaInst* alloca) { return llvm::isAllocaPromotable(alloca); });
+
+		if (!promotable.empty()) {
+			llvm::DominatorTree domTree;
+			domTree.recalculate(llFunction());
+			llvm::PromoteMemToReg(promotable, domTree);
+		}
+	}
+	mAllocasToPromote.clear();
+
 	return res;
 }
 
@@ -368,9 +402,18 @@ NodeCompiler* FunctionCompiler::getOrCreateNodeCompiler(NodeInstance& node) {
 	return &mNodeCompilers.emplace(&node, NodeCompiler{*this, node}).first->second;
 }
 
+const std::vector<NodeInstance*>& FunctionCompiler::dependentPures(NodeInstance& node) {
+	assert(&node.function() == &function() &&
+	       "Cannot get the dependent pures of a node instance not in this function");
+
+	auto iter = mDependentPures.find(&node);
+	if (iter != mDependentPures.end()) { return iter->second; }
+	return mDependentPures.emplace(&node, dependentPuresRecursive(node)).first->second;
+}
+
 Result compileFunction(const GraphFunction& func, llvm::Module* mod, llvm::DICompileUnit* debugCU,
-                       llvm::DIBuilder& debugBuilder) {
-	FunctionCompiler compiler{func, *mod, *debugCU, debugBuilder};
+                       llvm::DIBuilder& debugBuilder, Flags<CompileSettings> settings) {
+	FunctionCompiler compiler{func, *mod, *debugCU, debugBuilder, settings};
 
 	auto res = compiler.initialize();
 	if (!res) { return res; }
@@ -1,8 +1,10 @@
 /// \file GraphModule.cpp
 
 #include "chi/GraphModule.hpp"
+#include "chi/BitcodeParser.hpp"
 #include "chi/CCompiler.hpp"
 #include "chi/ClangFinder.hpp"
+#include "chi/ContentHasher.hpp"
 #include "chi/Context.hpp"
 #include "chi/FunctionCompiler.hpp"
 #include "chi/GraphFunction.hpp"
@@ -14,6 +16,7 @@
 #include "chi/NodeInstance.hpp"
 #include "chi/NodeType.hpp"
 #include "chi/Support/LibCLocator.hpp"
+#include "chi/Support/ParallelFor.hpp"
 #include "chi/Support/Result.hpp"
 #include "chi/Support/Subprocess.hpp"
 
@@ -32,11 +35,25 @@
 
 #include <boost/uuid/uuid_io.hpp>
 
+#include <algorithm>
+
 namespace fs = boost::filesystem;
 
 namespace chi {
 
 namespace {
+
+// The directory to cache the bitcode generated from C code in, next to the module cache, or an
+// empty path if there's no workspace to put it in
+fs::path cBitcodeCacheDir(const Context& ctx) {
+	return ctx.hasWorkspace() ? ctx.workspacePath() / "lib" / ".cbitcode" : fs::path{};
+}
+
+// The named metadata holding the hash of each piece of c-call code that has already been linked
+// into a module, so c-call nodes with the same code only link it in once. It's removed once the
+// module is generated
+constexpr auto linkedCCodeMetadata = "chi.linked-c-code";
+
 /// The NodeType for calling C functions
 struct CFuncNode : NodeType {
 	CFuncNode(GraphModule& mod, std::string cCode, std::string functionName,
@@ -63,45 +80,68 @@ struct CFuncNode : NodeType {
 
 		Result res;
 
-		// compile the c code if it hasn't already been compiled
-		if (llcompiledmod == nullptr) {
-			auto args = mExtraArguments;
-
-			// add -I for the .c dir
-			args.push_back("-I");
-			args.push_back(mGraphModule->pathToCSources().string());
+		auto parentModule = &compiler.llvmModule();
 
-			// find clang
-			auto clangExe = findClang();
-			if (clangExe.empty()) {
-				res.addEntry("EUKN", "Failed to find clang in path", nlohmann::json::object());
-				return res;
+		// only link the code in the first time it's used in this module, every other node with the
+		// same code calls the function that's already there
+		auto hash       = codeHash();
+		auto linkedCode = parentModule->getOrInsertNamedMetadata(linkedCCodeMetadata);
+		auto linked     = false;
+		for (auto idx = 0u; idx < linkedCode->getNumOperands(); ++idx) {
+			auto linkedHash = linkedCode->getOperand(idx);
+			if (llvm::cast<llvm::MDString>(linkedHash->getOperand(0))->getString() == hash) {
+				linked = true;
+				break;
 			}
+		}
 
-			res += compileCToLLVM(clangExe, context().llvmContext(), args, mCCode, &llcompiledmod);
+		if (!linked) {
+			// compile the c code if it hasn't already been compiled
+			if (llcompiledmod == nullptr) {
+				auto args = mExtraArguments;
 
-			if (!res) { return res; }
-		}
+				// add -I for the .c dir
+				args.push_back("-I");
+				args.push_back(mGraphModule->pathToCSources().string());
 
-		// create a copy of the module
-		auto copymod = llvm::CloneModule(llcompiledmod.get());
+				// find clang
+				auto clangExe = findClang();
+				if (clangExe.empty()) {
+					res.addEntry("EUKN", "Failed to find clang in path", nlohmann::json::object());
+					return res;
+				}
 
-		// link it in
+				res += compileCToLLVM(clangExe, context().llvmContext(), args, mCCode,
+				                      &llcompiledmod, cBitcodeCacheDir(context()));
 
-		auto parentModule = &compiler.llvmModule();
+				if (!res) { return res; }
+			}
 
+			// create a copy of the module
+			auto copymod = llvm::CloneModule(llcompiledmod.get());
+
+			// link it in
 #if LLVM_VERSION_LESS_EQUAL(3, 7)
-		llvm::Linker::LinkModules(parentModule, copymod
+			auto failed = llvm::Linker::LinkModules(parentModule, copymod
 #if LLVM_VERSION_LESS_EQUAL(3, 5)
-		                          ,
-		                          llvm::Linker::DestroySource, nullptr
+			                                        ,
+			                                        llvm::Linker::DestroySource, nullptr
 #endif
-		);
+			);
 #else
-		llvm::Linker::linkModules(*parentModule, std::move(copymod));
+			auto failed = llvm::Linker::linkModules(*parentModule, std::move(copymod));
 #endif
+			if (failed) {
+				res.addEntry("EUKN", "Failed to link C code into module",
+				             {{"Function Name", mFunctionName}});
+				return res;
+			}
+
+			parentModule->setDataLayout("");
 
-		parentModule->setDataLayout("");
+			auto& llctx = parentModule->getContext();
+			linkedCode->addOperand(llvm::MDNode::get(llctx, {llvm::MDString::get(llctx, hash)}));
+		}
 
 		auto llfunc = parentModule->getFunction(mFunctionName);
 		assert(llfunc != nullptr);
@@ -166,6 +206,16 @@ struct CFuncNode : NodeType {
 		                                   mInputs, mOutput);
 	}
 
+	// A hash of the code and everything it's compiled with, nodes with the same hash generate the
+	// same module
+	std::string codeHash() const {
+		ContentHasher hasher;
+		hasher.add(mCCode);
+		for (const auto& arg : mExtraArguments) { hasher.add(arg); }
+		hasher.add(mGraphModule->pathToCSources().string());
+		return hasher.hash();
+	}
+
 	std::string                mFunctionName;
 	std::string                mCCode;
 	std::vector<std::string>   mExtraArguments;
@@ -434,14 +484,22 @@ Result GraphModule::addForwardDeclarations(llvm::Module& module) const {
 	return {};
 }
 
-Result GraphModule::generateModule(llvm::Module& module) {
+Result GraphModule::generateModule(llvm::Module& module, Flags<CompileSettings> settings) {
+	std::unordered_set<std::string> allFunctions;
+	for (const auto& graph : mFunctions) { allFunctions.insert(graph->name()); }
+
+	return generateModule(module, settings, allFunctions);
+}
+
+Result GraphModule::generateModule(llvm::Module& module, Flags<CompileSettings> settings,
+                                   const std::unordered_set<std::string>& functions) {
 	Result res = {};
 
 	// if C support was enabled, compile the C files
 	if (cEnabled()) {
 		fs::path cPath = pathToCSources();
 		if (fs::is_directory(cPath)) {
-			// compile the files
+			std::vector<fs::path> cFiles;
 			for (auto direntry : boost::make_iterator_range(
 			         fs::recursive_directory_iterator{cPath, fs::symlink_option::recurse}, {})) {
 				const fs::path& CFile = direntry;
@@ -452,33 +510,55 @@ Result GraphModule::generateModule(llvm::Module& module) {
 				      CFile.extension() == ".c++" || CFile.extension() == ".cc")) {
 					continue;
 				}
+				cFiles.push_back(CFile);
+			}
+			// directory order isn't stable, and the files are linked in this order
+			std::sort(cFiles.begin(), cFiles.end());
 
-				// find clang
-				auto clangExe = findClang();
-				if (clangExe.empty()) {
-					res.addEntry("EUKN", "Failed to find clang in path", nlohmann::json::object());
-					return res;
-				}
-
-				// compile it
-				std::unique_ptr<llvm::Module> generatedModule;
-				res += compileCToLLVM(clangExe, context().llvmContext(), {CFile.string()}, "",
-				                      &generatedModule);
+			// find clang
+			auto clangExe = findClang();
+			if (!cFiles.empty() && clangExe.empty()) {
+				res.addEntry("EUKN", "Failed to find clang in path", nlohmann::json::object());
+				return res;
+			}
 
+			// run clang on all of them at once. Only the bitcode is generated on the worker
+			// threads, it's parsed into this module's LLVMContext here. When this module is
+			// already generated on one of compileModule's worker threads, they're run one by one
+			std::vector<std::string> bitcodes(cFiles.size());
+			std::vector<Result>      fileResults(cFiles.size());
+			auto                     cacheDir = cBitcodeCacheDir(context());
+			// every file can include any header in the directory, so read them all only once
+			auto headersDigest = cacheDir.empty() ? std::string{} : hashCHeaders(cPath);
+			parallelFor(cFiles.size(), defaultJobCount(), [&](size_t idx) {
+				fileResults[idx] = compileCToBitcode(clangExe, {cFiles[idx].string()}, "",
+				                                     &bitcodes[idx], cacheDir, headersDigest);
+			});
+
+			for (auto idx = 0ull; idx < cFiles.size(); ++idx) {
+				res += fileResults[idx];
 				if (!res) { return res; }
 
-					// link it
+				std::unique_ptr<llvm::Module> generatedModule;
+				res += parseBitcodeString(bitcodes[idx], context().llvmContext(), &generatedModule);
+				if (!res) { return res; }
 
+				// link it
 #if LLVM_VERSION_LESS_EQUAL(3, 7)
-				llvm::Linker::LinkModules(&module, generatedModule.get()
+				auto failed = llvm::Linker::LinkModules(&module, generatedModule.get()
 #if LLVM_VERSION_LESS_EQUAL(3, 5)
-				                                       ,
-				                          llvm::Linker::DestroySource, nullptr
+				                                                     ,
+				                                        llvm::Linker::DestroySource, nullptr
 #endif
 				);
 #else
-				llvm::Linker::linkModules(module, std::move(generatedModule));
+				auto failed = llvm::Linker::linkModules(module, std::move(generatedModule));
 #endif
+				if (failed) {
+					res.addEntry("EUKN", "Failed to link C code into module",
+					             {{"File", cFiles[idx].string()}});
+					return res;
+				}
 			}
 		}
 	}
@@ -501,19 +581,56 @@ Result GraphModule::generateModule(llvm::Module& module) {
 	addForwardDeclarations(module);
 
 	for (auto& graph : mFunctions) {
+		if (functions.find(graph->name()) == functions.end()) { continue; }
+
 		res += compileFunction(*graph, &module,
 #if LLVM_VERSION_LESS_EQUAL(3, 6)
 		                       &
 #endif
 		                       compileUnit,
-		                       debugBuilder);
+		                       debugBuilder, settings);
 	}
 
 	debugBuilder.finalize();
 
+	// nothing after this needs to know which C code was linked in
+	if (auto linkedCode = module.getNamedMetadata(linkedCCodeMetadata)) {
+		module.eraseNamedMetadata(linkedCode);
+	}
+
 	return res;
 }
 
+std::string GraphModule::contentHash() const {
+	ContentHasher hasher;
+
+	// the source path ends up in the debug info
+	hasher.add(sourceFilePath().generic_string());
+
+	// connections are serialized in node hash order, so sort them to make the JSON canonical
+	auto json = graphModuleToJson(*this);
+	for (auto& graph : json["graphs"]) {
+		auto& connections = graph["connections"];
+		std::sort(connections.begin(), connections.end());
+	}
+	hasher.add(json.dump());
+
+	// C files, and headers included by C calls, come from the .c directory
+	if (cEnabled() && fs::is_directory(pathToCSources())) {
+		std::vector<fs::path> files;
+		for (const auto& direntry : boost::make_iterator_range(
+		         fs::recursive_directory_iterator{pathToCSources(), fs::symlink_option::recurse},
+		         {})) {
+			if (fs::is_regular_file(direntry.path())) { files.push_back(direntry.path()); }
+		}
+		std::sort(files.begin(), files.end());
+
+		for (const auto& file : files) { hasher.addFile(file); }
+	}
+
+	return hasher.hash();
+}
+
 Result GraphModule::saveToDisk() const {
 	Result res;
 
@@ -886,7 +1003,8 @@ Result GraphModule::createNodeTypeFromCCode(boost::string_view         code,
 		return res;
 	}
 
-	res += compileCToLLVM(clangExe, context().llvmContext(), clangArgs, code, &mod);
+	res += compileCToLLVM(clangExe, context().llvmContext(), clangArgs, code, &mod,
+	                      cBitcodeCacheDir(context()));
 
 	if (!res) { return res; }
 
@@ -0,0 +1,145 @@
+/// \file JITObjectCache.cpp
+
+#include "chi/JITObjectCache.hpp"
+#include "chi/ContentHasher.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <ctime>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#if LLVM_VERSION_LESS_EQUAL(3, 9)
+#include <llvm/Bitcode/ReaderWriter.h>
+#else
+#include <llvm/Bitcode/BitcodeWriter.h>
+#endif
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace fs = boost::filesystem;
+
+namespace chi {
+
+constexpr size_t JITObjectCache::maxCachedObjects;
+
+JITObjectCache::JITObjectCache(fs::path cacheDir, llvm::CodeGenOpt::Level optLevel)
+    : mCacheDir{std::move(cacheDir)}, mOptLevel{optLevel} {}
+
+std::string JITObjectCache::cacheKeyForModule(const llvm::Module& mod) const {
+	std::string bitcode;
+	{
+		llvm::raw_string_ostream stream{bitcode};
+		llvm::WriteBitcodeToFile(&mod, stream);
+	}
+
+	ContentHasher hasher;
+	hasher.addCompilerVersion();
+	hasher.add(llvm::sys::getProcessTriple());
+	hasher.add(llvm::sys::getHostCPUName().str());
+	hasher.add(std::to_string(int(mOptLevel)));
+	hasher.add(bitcode);
+	return hasher.hash();
+}
+
+void JITObjectCache::setKey(const llvm::Module& mod, std::string key) {
+	mExplicitKeys[&mod] = std::move(key);
+}
+
+fs::path JITObjectCache::cachePathForModule(const llvm::Module& mod) const {
+	auto iter = mExplicitKeys.find(&mod);
+	if (iter != mExplicitKeys.end()) { return mCacheDir / (iter->second + ".o"); }
+
+	return mCacheDir / (cacheKeyForModule(mod) + ".o");
+}
+
+bool JITObjectCache::hasObject(const llvm::Module& mod) const {
+	return fs::is_regular_file(cachePathForModule(mod));
+}
+
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+void JITObjectCache::notifyObjectCompiled(const llvm::Module* mod, const llvm::MemoryBuffer* obj) {
+	auto objData = obj->getBuffer();
+#else
+void JITObjectCache::notifyObjectCompiled(const llvm::Module* mod, llvm::MemoryBufferRef obj) {
+	auto objData = obj.getBuffer();
+#endif
+	assert(mod != nullptr);
+
+	auto cachePath = cachePathForModule(*mod);
+	mExplicitKeys.erase(mod);
+
+	// a cache that can't be written to isn't an error, it just won't make anything faster
+	boost::system::error_code ec;
+	fs::create_directories(mCacheDir, ec);
+	if (ec) { return; }
+
+	// write to a temporary file first, so nobody reads a half written object. It has a unique name
+	// so another process storing the same object doesn't write over it
+	auto tmpPath = cachePath;
+	tmpPath += "." + fs::unique_path().string() + ".tmp";
+	{
+		fs::ofstream stream{tmpPath, std::ios::binary};
+		stream.write(objData.data(), objData.size());
+		if (!stream) {
+			stream.close();
+			fs::remove(tmpPath, ec);
+			return;
+		}
+	}
+
+	fs::rename(tmpPath, cachePath, ec);
+	if (ec) {
+		fs::remove(tmpPath, ec);
+		return;
+	}
+
+	// remove the least recently used objects
+	std::vector<std::pair<std::time_t, fs::path>> objects;
+	for (const auto& entry : boost::make_iterator_range(fs::directory_iterator{mCacheDir}, {})) {
+		if (fs::is_regular_file(entry.path()) && entry.path().extension() == ".o") {
+			objects.emplace_back(fs::last_write_time(entry.path()), entry.path());
+		}
+	}
+	if (objects.size() <= maxCachedObjects) { return; }
+
+	std::sort(objects.begin(), objects.end(),
+	          [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+	for (auto idx = maxCachedObjects; idx < objects.size(); ++idx) {
+		fs::remove(objects[idx].second, ec);
+	}
+}
+
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+llvm::MemoryBuffer* JITObjectCache::getObject(const llvm::Module* mod) {
+#else
+std::unique_ptr<llvm::MemoryBuffer> JITObjectCache::getObject(const llvm::Module* mod) {
+#endif
+	assert(mod != nullptr);
+
+	auto cachePath = cachePathForModule(*mod);
+	if (!fs::is_regular_file(cachePath)) { return nullptr; }
+
+	auto objOrError = llvm::MemoryBuffer::getFile(cachePath.string());
+	if (!objOrError) { return nullptr; }
+	mExplicitKeys.erase(mod);
+
+	// mark it as used so it isn't pruned
+	boost::system::error_code ec;
+	fs::last_write_time(cachePath, std::time(nullptr), ec);
+
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+	return objOrError.get().release();
+#else
+	return std::move(objOrError.get());
+#endif
+}
+
+}  // namespace chi
@@ -153,6 +153,22 @@ Result createGraphFunctionDeclarationFromJson(GraphModule&          createInside
 	}
 	std::string description = input["description"];
 
+	// the inline policy is optional, and auto if it's not there
+	auto inlinePolicy = InlinePolicy::Auto;
+	if (input.find("inline") != input.end()) {
+		if (input["inline"] == "always") {
+			inlinePolicy = InlinePolicy::Always;
+		} else if (input["inline"] == "never") {
+			inlinePolicy = InlinePolicy::Never;
+		} else if (input["inline"] != "auto") {
+			res.addEntry("E53", "JSON in graph has an invalid inline policy",
+			             {{"Function Name", name},
+			              {"Module Name", createInside.fullName()},
+			              {"Given Policy", input["inline"]}});
+			return res;
+		}
+	}
+
 	if (input.find("data_inputs") == input.end() || !input["data_inputs"].is_array()) {
 		res.addEntry("E43", "JSON in graph doesn't have an data_inputs array", {});
 		return res;
@@ -224,6 +240,7 @@ Result createGraphFunctionDeclarationFromJson(GraphModule&          createInside
 	auto created =
 	    createInside.getOrCreateFunction(name, datainputs, dataoutputs, execinputs, execoutputs);
 	created->setDescription(std::move(description));
+	created->setInlinePolicy(inlinePolicy);
 	if (toFill != nullptr) { *toFill = created; }
 
 	return res;
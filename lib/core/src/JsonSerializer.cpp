@@ -19,6 +19,13 @@ nlohmann::json graphFunctionToJson(const GraphFunction& func) {
 	jsonData["name"]        = func.name();
 	jsonData["description"] = func.description();
 
+	// only write it if it isn't the default, so older files stay the same
+	switch (func.inlinePolicy()) {
+	case InlinePolicy::Always: jsonData["inline"] = "always"; break;
+	case InlinePolicy::Never: jsonData["inline"] = "never"; break;
+	case InlinePolicy::Auto: break;
+	}
+
 	auto& datainputsjson = jsonData["data_inputs"];
 	datainputsjson       = nlohmann::json::array();
 
@@ -909,5 +909,5 @@ DataType LangModule::typeFromName(boost::string_view name) {
 
 Result LangModule::addForwardDeclarations(llvm::Module&) const { return {}; }
 
-Result LangModule::generateModule(llvm::Module&) { return {}; }
+Result LangModule::generateModule(llvm::Module&, Flags<CompileSettings>) { return {}; }
 }  // namespace chi
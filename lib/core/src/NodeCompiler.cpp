@@ -5,7 +5,10 @@
 #include "chi/Context.hpp"
 #include "chi/DataType.hpp"
 #include "chi/FunctionCompiler.hpp"
+#include "chi/GraphFunction.hpp"
+#include "chi/GraphModule.hpp"
 #include "chi/LLVMVersion.hpp"
+#include "chi/LangModule.hpp"
 #include "chi/NodeInstance.hpp"
 #include "chi/NodeType.hpp"
 #include "chi/Support/Result.hpp"
@@ -15,10 +18,46 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 
+#include <algorithm>
+
 namespace fs = boost::filesystem;
 
 namespace chi {
 
+namespace {
+
+// Check if `pred` is true for a pure node or any of the pures it depends on
+template <typename Predicate>
+bool anyInPureTree(NodeInstance& pure, const Predicate& pred,
+                   std::unordered_set<NodeInstance*>& visited) {
+	if (!visited.insert(&pure).second) { return false; }
+	if (pred(pure)) { return true; }
+
+	for (const auto& conn : pure.inputDataConnections) {
+		if (conn.first != nullptr && conn.first->type().pure() &&
+		    anyInPureTree(*conn.first, pred, visited)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Check if `constant` is `global` or is built from it, like a constant GEP into a string
+bool refersTo(const llvm::Constant& constant, const llvm::GlobalValue& global) {
+	if (&constant == &global) { return true; }
+
+	// don't look into other globals' initializers, they're separate values
+	if (llvm::isa<llvm::GlobalValue>(constant)) { return false; }
+
+	for (const auto& operand : constant.operands()) {
+		auto constOperand = llvm::dyn_cast<llvm::Constant>(operand.get());
+		if (constOperand != nullptr && refersTo(*constOperand, global)) { return true; }
+	}
+	return false;
+}
+
+}  // anonymous namespace
+
 NodeCompiler::NodeCompiler(FunctionCompiler& functionCompiler, NodeInstance& inst)
     : mCompiler{&functionCompiler}, mNode{&inst} {
 	// alloca the outputs
@@ -29,9 +68,10 @@ NodeCompiler::NodeCompiler(FunctionCompiler& functionCompiler, NodeInstance& ins
 		// alloca the outputs
 		auto alloca = allocBuilder.CreateAlloca(namedType.type.llvmType(), nullptr,
 		                                        node().stringId() + "__" + std::to_string(idx));
+		funcCompiler().promoteToRegister(*alloca);
 
-		// create debug info for the alloca
-		{
+		// create debug info for the alloca, unless it's going to be a register
+		if (!(funcCompiler().settings() & CompileSettings::SSAOutputs)) {
 			// get type
 			llvm::DIType* dType = namedType.type.debugType();
 
@@ -81,14 +121,19 @@ NodeCompiler::NodeCompiler(FunctionCompiler& functionCompiler, NodeInstance& ins
 
 	// resize the inputexec specific variables
 	mPureBlocks.resize(size);
+	mPureNodes.resize(size);
 	mCodeBlocks.resize(size, nullptr);
 
 	mCompiledInputs.resize(size, false);
+
+	mAvailablePures.resize(size);
+	mFoundAvailablePures.resize(size, false);
 }
 
 bool NodeCompiler::pure() const { return node().type().pure(); }
 
 void NodeCompiler::compile_stage1(size_t inputExecID) {
+	assert(!pure() && "Pure nodes are compiled into their users with compilePureInto");
 	assert(inputExecID < inputExecs() &&
 	       "Cannot compile_stage1 for a inputexec that doesn't exist");
 
@@ -102,55 +147,31 @@ void NodeCompiler::compile_stage1(size_t inputExecID) {
 	    context().llvmContext(), "node_" + node().stringId() + "__" + std::to_string(inputExecID),
 	    &funcCompiler().llFunction());
 
-	// only do this for non-pure nodes because pure nodes don't call their dependencies, they are
-	// called by the non-pure
-	if (!pure()) {
-		// generate code for all the dependent pures
-		auto depPures = dependentPuresRecursive(node());
-
-		// set our vector to be the same length
-		auto& pureBlocks = mPureBlocks[inputExecID];
-		pureBlocks.resize(depPures.size());
-
-		// create the first pure block--the loop only creates the next one
-		if (!depPures.empty()) {
-			pureBlocks[0] = llvm::BasicBlock::Create(context().llvmContext(),
-			                                         "node_" + node().stringId() + "__" +
-			                                             std::to_string(inputExecID) + "__" +
-			                                             depPures[0]->stringId(),
-			                                         &funcCompiler().llFunction());
+	// create a block for each dependent pure that needs to be computed before the code block. Each
+	// is only computed once, and pures that are still valid from the node that ran before this one
+	// are reused. Folded pures don't need a block at all. They're filled in compile_stage2, once
+	// the node is actually being compiled
+	const auto& available  = availablePures(inputExecID);
+	auto&       pureNodes  = mPureNodes[inputExecID];
+	auto&       pureBlocks = mPureBlocks[inputExecID];
+	for (auto depPure : funcCompiler().dependentPures(node())) {
+		if (available.count(depPure) != 0 ||
+		    !funcCompiler().getOrCreateNodeCompiler(*depPure)->constantOutputs().empty()) {
+			continue;
 		}
 
-		for (auto id = 0ull; id < depPures.size(); ++id) {
-			// create a BasicBlock for the next one to br to--if we're on the last one, use the code
-			// block
-			llvm::BasicBlock* nextBlock = [&] {
-				if (id == depPures.size() - 1) { return codeBlock; }
-				pureBlocks[id + 1] = llvm::BasicBlock::Create(
-				    context().llvmContext(),
-				    "node_" + node().stringId() + "__" + std::to_string(inputExecID) + "__" +
-				        depPures[id + 1]->stringId(),
-				    &funcCompiler().llFunction());
-				return pureBlocks[id + 1];
-			}();
-
-			// add nextBlock to the list of possible locations for the indirectbr
-			funcCompiler().nodeCompiler(*depPures[id])->jumpBackInst().addDestination(nextBlock);
-
-			// set post-pure break to go to the next one
-			llvm::IRBuilder<> irBuilder{pureBlocks[id]};
-			irBuilder.CreateStore(llvm::BlockAddress::get(nextBlock),
-			                      &funcCompiler().postPureBreak());
-
-			// br to the pure, terminating that BasicBlock
-			irBuilder.CreateBr(&funcCompiler().nodeCompiler(*depPures[id])->firstBlock(0));
-		}
+		pureNodes.push_back(depPure);
+		pureBlocks.push_back(llvm::BasicBlock::Create(
+		    context().llvmContext(), "node_" + node().stringId() + "__" +
+		                                 std::to_string(inputExecID) + "__" + depPure->stringId(),
+		    &funcCompiler().llFunction(), codeBlock));
 	}
 }
 
 Result NodeCompiler::compile_stage2(std::vector<llvm::BasicBlock*> trailingBlocks,
                                     size_t                         inputExecID) {
-	assert((pure() || trailingBlocks.size() == node().outputExecConnections.size()) &&
+	assert(!pure() && "Pure nodes are compiled into their users with compilePureInto");
+	assert(trailingBlocks.size() == node().outputExecConnections.size() &&
 	       "Trailing blocks is the wrong size");
 	assert(inputExecID < inputExecs());
 
@@ -161,7 +182,195 @@ Result NodeCompiler::compile_stage2(std::vector<llvm::BasicBlock*> trailingBlock
 
 	// if we haven't done stage 1, then do it
 	if (codeBlock == nullptr) { compile_stage1(inputExecID); }
-	llvm::IRBuilder<> codeBuilder{codeBlock};
+
+	Result res;
+
+	// generate each of the dependent pures inline, each falling through to the next and the last
+	// one to the code block, so there are only direct branches
+	const auto& pureNodes  = mPureNodes[inputExecID];
+	const auto& pureBlocks = mPureBlocks[inputExecID];
+	assert(pureNodes.size() == pureBlocks.size());
+	for (auto id = 0ull; id < pureNodes.size(); ++id) {
+		auto nextBlock = id == pureNodes.size() - 1 ? codeBlock : pureBlocks[id + 1];
+
+		res += funcCompiler().getOrCreateNodeCompiler(*pureNodes[id])->compilePureInto(
+		    *pureBlocks[id], *nextBlock);
+		if (!res) { return res; }
+	}
+
+	res += codegenInto(*codeBlock, inputExecID, std::move(trailingBlocks));
+
+	mCompiledInputs[inputExecID] = true;
+
+	return res;
+}
+
+const std::unordered_set<NodeInstance*>& NodeCompiler::availablePures(size_t inputExecID) {
+	assert(!pure() && "Pure nodes don't have available pures, they're compiled into their users");
+	assert(inputExecID < inputExecs());
+
+	auto& available = mAvailablePures[inputExecID];
+	if (mFoundAvailablePures[inputExecID]) { return available; }
+
+	// set this first, so a cycle of nodes just finds nothing available
+	mFoundAvailablePures[inputExecID] = true;
+
+	// values can only be reused if this always runs right after the same code, which is when it has
+	// one exec connection coming in, from a node with one input exec
+	if (inputExecID >= node().inputExecConnections.size() ||
+	    node().inputExecConnections[inputExecID].size() != 1) {
+		return available;
+	}
+	auto previous = node().inputExecConnections[inputExecID][0].first;
+	if (previous == nullptr) { return available; }
+
+	auto previousCompiler = funcCompiler().getOrCreateNodeCompiler(*previous);
+	if (previousCompiler->inputExecs() != 1) { return available; }
+
+	available = previousCompiler->puresAfter(0);
+	return available;
+}
+
+std::unordered_set<NodeInstance*> NodeCompiler::puresAfter(size_t inputExecID) {
+	auto after = availablePures(inputExecID);
+	const auto& depPures = funcCompiler().dependentPures(node());
+	after.insert(depPures.begin(), depPures.end());
+
+	// this node can change what some of them read: its own outputs, and the local variable it sets
+	// if it's a setter
+	auto typeName  = node().type().name();
+	auto setsLocal = &node().type().module() == &funcCompiler().module() &&
+	                 typeName.substr(0, 5) == "_set_";
+	auto getterName = setsLocal ? "_get_" + typeName.substr(5) : std::string{};
+
+	auto readsChangedValue = [&](NodeInstance& inst) {
+		for (const auto& conn : inst.inputDataConnections) {
+			if (conn.first == &node()) { return true; }
+		}
+		return setsLocal && &inst.type().module() == &funcCompiler().module() &&
+		       inst.type().name() == getterName;
+	};
+
+	for (auto iter = after.begin(); iter != after.end();) {
+		std::unordered_set<NodeInstance*> visited;
+		if (anyInPureTree(**iter, readsChangedValue, visited)) {
+			iter = after.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+
+	return after;
+}
+
+Result NodeCompiler::compilePureInto(llvm::BasicBlock& block, llvm::BasicBlock& nextBlock) {
+	assert(pure() && "Only pure nodes can be compiled into their users");
+
+	return codegenInto(block, 0, {&nextBlock});
+}
+
+const std::vector<llvm::Constant*>& NodeCompiler::constantOutputs() {
+	if (mTriedFolding) { return mConstantOutputs; }
+	mTriedFolding = true;
+
+	// only the LangModule's pures are folded, as they just compute their outputs from their inputs
+	if (!(funcCompiler().settings() & CompileSettings::FoldConstants) || !pure() ||
+	    &node().type().module() != context().langModule() || mReturnValues.empty()) {
+		return mConstantOutputs;
+	}
+
+	// inputs and outputs, like in codegenInto
+	std::vector<llvm::Value*> io;
+	for (const auto& conn : node().inputDataConnections) {
+		if (conn.first == nullptr || !conn.first->type().pure()) { return mConstantOutputs; }
+
+		const auto& remoteConstants =
+		    funcCompiler().getOrCreateNodeCompiler(*conn.first)->constantOutputs();
+		if (remoteConstants.empty()) { return mConstantOutputs; }
+
+		io.push_back(remoteConstants[conn.second]);
+	}
+	std::copy(mReturnValues.begin(), mReturnValues.end(), std::back_inserter(io));
+
+	// remember what was there before, so everything folding makes can be removed after
+	auto&                            llFunc   = funcCompiler().llFunction();
+	auto&                            llModule = *llFunc.getParent();
+	std::unordered_set<llvm::Value*> existing;
+	for (auto& block : llFunc) { existing.insert(&block); }
+	for (auto iter = llModule.global_begin(); iter != llModule.global_end(); ++iter) {
+		existing.insert(&*iter);
+	}
+	for (auto& func : llModule) { existing.insert(&func); }
+
+	// generate the node into a block that's thrown away. IRBuilder folds instructions that only
+	// use constants, so if all that's left is storing constants to the outputs, those are the
+	// values
+	auto foldBlock = llvm::BasicBlock::Create(context().llvmContext(), "fold", &llFunc);
+	auto endBlock  = llvm::BasicBlock::Create(context().llvmContext(), "fold_end", &llFunc);
+
+	auto res = node().type().codegen(*this, *foldBlock, 0, llvm::DebugLoc{}, io, {endBlock});
+
+	std::vector<llvm::Constant*> outputs(mReturnValues.size(), nullptr);
+	auto                         foldable = !!res;
+	for (auto& inst : *foldBlock) {
+		if (&inst == foldBlock->getTerminator()) { continue; }
+
+		auto store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+		if (store == nullptr) {
+			foldable = false;
+			break;
+		}
+
+		auto outputIter =
+		    std::find(mReturnValues.begin(), mReturnValues.end(), store->getPointerOperand());
+		auto constant = llvm::dyn_cast<llvm::Constant>(store->getValueOperand());
+
+		// dividing by zero is left for runtime. IRBuilder folds it to undef, or to a constant
+		// expression that can trap
+		if (constant != nullptr && (llvm::isa<llvm::UndefValue>(constant) || constant->canTrap())) {
+			mFoldingTraps = true;
+		}
+		if (outputIter == mReturnValues.end() || constant == nullptr || mFoldingTraps) {
+			foldable = false;
+			break;
+		}
+		outputs[outputIter - mReturnValues.begin()] = constant;
+	}
+
+	auto folded = foldable && std::find(outputs.begin(), outputs.end(), nullptr) == outputs.end();
+
+	// remove every block the node made, not just the two made here. They can only refer to each
+	// other, so drop those references before erasing any of them
+	std::vector<llvm::BasicBlock*> newBlocks;
+	for (auto& block : llFunc) {
+		if (existing.find(&block) == existing.end()) { newBlocks.push_back(&block); }
+	}
+	for (auto block : newBlocks) { block->dropAllReferences(); }
+	for (auto block : newBlocks) { block->eraseFromParent(); }
+
+	// and the globals it made, unless they're part of the folded values (like a string literal)
+	std::vector<llvm::GlobalValue*> newGlobals;
+	for (auto iter = llModule.global_begin(); iter != llModule.global_end(); ++iter) {
+		if (existing.find(&*iter) == existing.end()) { newGlobals.push_back(&*iter); }
+	}
+	for (auto& func : llModule) {
+		if (existing.find(&func) == existing.end()) { newGlobals.push_back(&func); }
+	}
+	for (auto global : newGlobals) {
+		auto usedByOutput = [&](llvm::Constant* output) { return refersTo(*output, *global); };
+		if (folded && std::any_of(outputs.begin(), outputs.end(), usedByOutput)) { continue; }
+
+		global->removeDeadConstantUsers();
+		if (global->use_empty()) { global->eraseFromParent(); }
+	}
+
+	if (folded) { mConstantOutputs = std::move(outputs); }
+	return mConstantOutputs;
+}
+
+Result NodeCompiler::codegenInto(llvm::BasicBlock& block, size_t inputExecID,
+                                 std::vector<llvm::BasicBlock*> trailingBlocks) {
+	llvm::IRBuilder<> codeBuilder{&block};
 
 	// inputs and outputs (inputs followed by outputs)
 	std::vector<llvm::Value*> io;
@@ -172,12 +381,23 @@ Result NodeCompiler::compile_stage2(std::vector<llvm::BasicBlock*> trailingBlock
 		auto& remoteNode = *connection.first;
 		auto  remoteID   = connection.second;
 
-		assert(remoteID < funcCompiler().nodeCompiler(remoteNode)->returnValues().size() &&
+		auto remoteCompiler = funcCompiler().nodeCompiler(remoteNode);
+		assert(remoteID < remoteCompiler->returnValues().size() &&
 		       "Internal error: connection to a value doesn't exist");
 
-		auto loaded = codeBuilder.CreateLoad(
-		    funcCompiler().nodeCompiler(remoteNode)->returnValues()[remoteID]);
-		io.push_back(loaded);
+		// folded values are used directly, the others are loaded from the output. If folding this
+		// node would trap, the folded values are stored to the output first, so IRBuilder doesn't
+		// fold it here instead
+		const auto& remoteConstants = remoteCompiler->constantOutputs();
+		if (!remoteConstants.empty() && !mFoldingTraps) {
+			io.push_back(remoteConstants[remoteID]);
+		} else {
+			if (!remoteConstants.empty()) {
+				codeBuilder.CreateStore(remoteConstants[remoteID],
+				                        remoteCompiler->returnValues()[remoteID]);
+			}
+			io.push_back(codeBuilder.CreateLoad(remoteCompiler->returnValues()[remoteID]));
+		}
 
 		assert(io[io.size() - 1]->getType() == node().type().dataInputs()[idx].type.llvmType() &&
 		       "Internal error: types do not match");
@@ -186,29 +406,11 @@ Result NodeCompiler::compile_stage2(std::vector<llvm::BasicBlock*> trailingBlock
 	// add outputs
 	std::copy(mReturnValues.begin(), mReturnValues.end(), std::back_inserter(io));
 
-	// on pure, jump to the set loc
-	if (pure()) {
-		auto brBlock = llvm::BasicBlock::Create(context().llvmContext(),
-		                                        "node_" + node().stringId() + "_jumpback",
-		                                        &funcCompiler().llFunction());
-		llvm::IRBuilder<> builder(brBlock);
-
-		mJumpBackInst =
-		    builder.CreateIndirectBr(builder.CreateLoad(&funcCompiler().postPureBreak()));
-
-		trailingBlocks.resize(1);
-		trailingBlocks[0] = brBlock;
-	}
-
 	// codegen
-	Result res = node().type().codegen(
-	    *this, *codeBlock, inputExecID,
+	return node().type().codegen(
+	    *this, block, inputExecID,
 	    llvm::DebugLoc::get(funcCompiler().nodeLineNumber(node()), 1, funcCompiler().diFunction()),
 	    io, trailingBlocks);
-
-	mCompiledInputs[inputExecID] = true;
-
-	return res;
 }
 
 llvm::BasicBlock& NodeCompiler::firstBlock(size_t inputExecID) const {
@@ -242,20 +444,31 @@ size_t NodeCompiler::inputExecs() const {
 }
 
 std::vector<NodeInstance*> dependentPuresRecursive(const NodeInstance& inst) {
-	std::vector<NodeInstance*> ret;
+	std::vector<NodeInstance*>              ret;
+	std::unordered_set<const NodeInstance*> visited{&inst};
+
+	// a post-order depth first search with an explicit stack, so long chains of pures can't
+	// overflow it. Each frame is a node (nullptr for `inst`) and the next input to look at
+	std::vector<std::pair<NodeInstance*, size_t>> stack;
+	stack.emplace_back(nullptr, 0);
+	while (!stack.empty()) {
+		auto  node   = stack.back().first;
+		auto& inputs = node == nullptr ? inst.inputDataConnections : node->inputDataConnections;
+
+		// all of its dependencies are in, so it can go in
+		if (stack.back().second == inputs.size()) {
+			if (node != nullptr) { ret.push_back(node); }
+			stack.pop_back();
+			continue;
+		}
 
-	// TODO: remove duplicates in some intellegent way
-	for (const auto& conn : inst.inputDataConnections) {
-		// if it isn't connected (this really shouldn't happen because that would fail validation),
-		// then skip.
-		if (conn.first == nullptr) { continue; }
+		auto dep = inputs[stack.back().second++].first;
 
-		if (conn.first->type().pure()) {
-			auto deps = dependentPuresRecursive(*conn.first);
-			std::copy(deps.begin(), deps.end(), std::back_inserter(ret));
+		// if it isn't connected (this really shouldn't happen because that would fail validation),
+		// then skip. Pures that are already in (or on the stack, for cycles) are skipped too
+		if (dep == nullptr || !dep->type().pure() || !visited.insert(dep).second) { continue; }
 
-			ret.push_back(conn.first);
-		}
+		stack.emplace_back(dep, 0);
 	}
 
 	return ret;
@@ -0,0 +1,70 @@
+/// \file Optimizer.cpp
+
+#include "chi/Optimizer.hpp"
+#include "chi/LLVMVersion.hpp"
+
+#include <llvm/IR/Module.h>
+
+#if LLVM_VERSION_AT_LEAST(4, 0)
+#include <llvm/Passes/PassBuilder.h>
+#else
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#endif
+
+namespace chi {
+
+void optimizeModule(llvm::Module& mod, llvm::CodeGenOpt::Level optLevel) {
+	if (optLevel == llvm::CodeGenOpt::None) { return; }
+
+#if LLVM_VERSION_AT_LEAST(4, 0)
+	llvm::PassBuilder passBuilder;
+
+	llvm::LoopAnalysisManager     loopAnalyses;
+	llvm::FunctionAnalysisManager functionAnalyses;
+	llvm::CGSCCAnalysisManager    cgsccAnalyses;
+	llvm::ModuleAnalysisManager   moduleAnalyses;
+
+	passBuilder.registerModuleAnalyses(moduleAnalyses);
+	passBuilder.registerCGSCCAnalyses(cgsccAnalyses);
+	passBuilder.registerFunctionAnalyses(functionAnalyses);
+	passBuilder.registerLoopAnalyses(loopAnalyses);
+	passBuilder.crossRegisterProxies(loopAnalyses, functionAnalyses, cgsccAnalyses,
+	                                 moduleAnalyses);
+
+	auto level = llvm::PassBuilder::O2;
+	switch (optLevel) {
+	case llvm::CodeGenOpt::Less: level = llvm::PassBuilder::O1; break;
+	case llvm::CodeGenOpt::Aggressive: level = llvm::PassBuilder::O3; break;
+	default: break;
+	}
+
+	auto passes = passBuilder.buildPerModuleDefaultPipeline(level);
+	passes.run(mod, moduleAnalyses);
+#else
+	auto levelInt = unsigned(optLevel);
+
+	llvm::PassManagerBuilder passBuilder;
+	passBuilder.OptLevel = levelInt;
+	if (levelInt > 1) {
+		passBuilder.Inliner       = llvm::createFunctionInliningPass(levelInt, 1);
+		passBuilder.LoopVectorize = true;
+		passBuilder.SLPVectorize  = true;
+	}
+
+	llvm::legacy::FunctionPassManager fpm{&mod};
+	passBuilder.populateFunctionPassManager(fpm);
+
+	llvm::legacy::PassManager mpm;
+	passBuilder.populateModulePassManager(mpm);
+
+	fpm.doInitialization();
+	for (auto& func : mod) { fpm.run(func); }
+	fpm.doFinalization();
+
+	mpm.run(mod);
+#endif
+}
+
+}  // namespace chi
@@ -15,6 +15,11 @@ namespace chi {
 /// \{
 
 /// Gets the location of the standard C library to include
+/// They come from the `CHI_STDC_INCLUDE_PATH` environment variable if it's set, which is `:`
+/// separated, and otherwise from asking gcc. gcc is only run the first time this succeeds in a
+/// process, and the paths are reused after that. It's safe to call from many threads at once.
+/// \param toFill The vector to append the include paths to
+/// \return The Result
 Result stdCIncludePaths(std::vector<boost::filesystem::path>& toFill);
 
 /// \}
@@ -0,0 +1,67 @@
+/// \file chi/Support/ParallelFor.hpp
+/// Defines a minimal bounded parallel for loop
+
+#pragma once
+
+#ifndef CHI_SUPPORT_PARALLEL_FOR_HPP
+#define CHI_SUPPORT_PARALLEL_FOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace chi {
+
+/// Get the default number of jobs to run at once, which is the number of hardware threads
+/// \return The number of jobs, at least 1
+inline unsigned defaultJobCount() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+namespace detail {
+// if this thread is running an iteration of a parallelFor that runs on more than one thread
+inline bool& inParallelFor() {
+	static thread_local bool inside = false;
+	return inside;
+}
+}  // namespace detail
+
+/// Call `func(idx)` for each `idx` in `[0, count)` on at most `jobs` threads
+/// Every index is visited exactly once, but in no particular order, so `func` should write its
+/// results to a slot indexed by `idx` to keep the output deterministic.
+/// The calling thread does work as well, and if `jobs <= 1` everything is run on it in order.
+/// A parallelFor called from inside one that already runs on many threads is run in order on
+/// the calling thread too, so nesting them doesn't use more than `jobs` threads.
+/// \param count The number of indices to visit
+/// \param jobs The maximum number of threads to use
+/// \param func The function to call, with the signature `void(size_t)`
+template <typename Func>
+void parallelFor(size_t count, unsigned jobs, Func&& func) {
+	if (jobs <= 1 || count <= 1 || detail::inParallelFor()) {
+		for (size_t idx = 0; idx < count; ++idx) { func(idx); }
+		return;
+	}
+
+	std::atomic<size_t> nextIdx{0};
+	auto                worker = [&] {
+		auto& inside    = detail::inParallelFor();
+		auto  wasInside = inside;
+		inside          = true;
+		for (auto idx = nextIdx++; idx < count; idx = nextIdx++) { func(idx); }
+		inside = wasInside;
+	};
+
+	auto threadCount = std::min<size_t>(jobs, count) - 1;
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; ++i) { threads.emplace_back(worker); }
+
+	worker();
+
+	for (auto& thread : threads) { thread.join(); }
+}
+
+}  // namespace chi
+
+#endif  // CHI_SUPPORT_PARALLEL_FOR_HPP
@@ -10,6 +10,7 @@ namespace fs = boost::filesystem;
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <cstdlib>
+#include <mutex>
 
 #include "chi/Support/Result.hpp"
 #include "chi/Support/Subprocess.hpp"
@@ -19,21 +20,10 @@ namespace chi {
 // The linux implementation finds gcc and runs what's basically gcc -xc -E -v - < /dev/null which
 // prints out the search paths.
 
-Result stdCIncludePaths(std::vector<boost::filesystem::path>& toFill) {
-	Result res;
-
-	// first see if CHI_STDC_INCLUDE_PATH is defined in the environment
-	auto envIncPath = std::getenv("CHI_STDC_INCLUDE_PATH");
-	if (envIncPath != nullptr) {
-		std::string envIncPathStr = envIncPath;
-
-		std::vector<std::string> parsedOut;
-		boost::algorithm::split(parsedOut, envIncPathStr, boost::algorithm::is_any_of(":"));
+namespace {
 
-		std::transform(parsedOut.begin(), parsedOut.end(), std::back_inserter(toFill),
-		               [](auto p) { return fs::path{p}; });
-		return res;
-	}
+Result gccIncludePaths(std::vector<boost::filesystem::path>& toFill) {
+	Result res;
 
 	// find gcc
 	std::string              colonSeparatedPath = std::getenv("PATH");
@@ -110,6 +100,46 @@ Result stdCIncludePaths(std::vector<boost::filesystem::path>& toFill) {
 
 	return res;
 }
+
+}  // anonymous namespace
+
+Result stdCIncludePaths(std::vector<boost::filesystem::path>& toFill) {
+	Result res;
+
+	// first see if CHI_STDC_INCLUDE_PATH is defined in the environment
+	auto envIncPath = std::getenv("CHI_STDC_INCLUDE_PATH");
+	if (envIncPath != nullptr) {
+		std::string envIncPathStr = envIncPath;
+
+		std::vector<std::string> parsedOut;
+		boost::algorithm::split(parsedOut, envIncPathStr, boost::algorithm::is_any_of(":"));
+
+		std::transform(parsedOut.begin(), parsedOut.end(), std::back_inserter(toFill),
+		               [](auto p) { return fs::path{p}; });
+		return res;
+	}
+
+	// gcc's answer won't change while this process is running, so only ask once. Other threads
+	// wait for the first one to finish instead of running gcc too. If it fails, the next call
+	// tries again.
+	static std::mutex            gccMutex;
+	static bool                  gccAsked = false;
+	static std::vector<fs::path> gccPaths;
+
+	std::lock_guard<std::mutex> lock{gccMutex};
+	if (!gccAsked) {
+		res += gccIncludePaths(gccPaths);
+		if (!res) {
+			gccPaths.clear();
+			return res;
+		}
+		gccAsked = true;
+	}
+
+	toFill.insert(toFill.end(), gccPaths.begin(), gccPaths.end());
+	return res;
+}
+
 }  // chi
 
 #elif defined WIN32
@@ -4,6 +4,8 @@
 
 #include <boost/range/adaptor/reversed.hpp>
 
+#include <atomic>
+
 namespace {
 
 /// merges `from` into `into`. If an entry is in both, it keeps into.
@@ -84,10 +86,12 @@ std::string Result::dump() const {
 int Result::addContext(const nlohmann::json& data) {
 	assert(data.is_object() && "Json added to context must be an object");
 
-	static int ctxId = 0;
+	// Results are used on worker threads too
+	static std::atomic<int> nextCtxId{0};
 
+	auto ctxId = nextCtxId++;
 	mContexts.emplace(ctxId, data);
-	return ctxId++;
+	return ctxId;
 }
 
 void chi::Result::removeContext(int id) { mContexts.erase(id); }
@@ -0,0 +1,257 @@
+#include <catch.hpp>
+#include "TestCommon.hpp"
+
+#include <chi/BitcodeParser.hpp>
+#include <chi/CCompiler.hpp>
+#include <chi/ClangFinder.hpp>
+#include <chi/Context.hpp>
+#include <chi/DataType.hpp>
+#include <chi/GraphFunction.hpp>
+#include <chi/GraphModule.hpp>
+#include <chi/LangModule.hpp>
+#include <chi/NodeInstance.hpp>
+#include <chi/NodeType.hpp>
+#include <chi/Support/ParallelFor.hpp>
+#include <chi/Support/Result.hpp>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+using namespace chi;
+
+TEST_CASE("compileCToLLVM caches bitcode", "") {
+	GIVEN("An empty cache directory") {
+		auto clangExe = findClang();
+		if (clangExe.empty()) {
+			WARN("clang wasn't found, so C code can't be compiled");
+			return;
+		}
+
+		auto cacheDir = fs::temp_directory_path() / fs::unique_path();
+
+		llvm::LLVMContext llctx;
+		Result            res;
+
+		auto countCached = [&] {
+			return std::count_if(fs::directory_iterator{cacheDir}, fs::directory_iterator{},
+			                     [](const fs::directory_entry& entry) {
+				                     return entry.path().extension() == ".bc";
+				                 });
+		};
+
+		auto compileWith = [&](std::vector<std::string> args, const char* code) {
+			std::unique_ptr<llvm::Module> mod;
+			res += compileCToLLVM(clangExe, llctx, std::move(args), code, &mod, cacheDir);
+			REQUIRE(!!res);
+			REQUIRE(mod != nullptr);
+			REQUIRE(mod->getFunction("answer") != nullptr);
+		};
+		auto compile = [&](const char* code) { compileWith({}, code); };
+
+		WHEN("Some code is compiled") {
+			compile("int answer() { return 42; }");
+
+			THEN("Its bitcode is cached") { REQUIRE(countCached() == 1); }
+
+			THEN("Compiling it again uses the cached bitcode") {
+				compile("int answer() { return 42; }");
+				REQUIRE(countCached() == 1);
+			}
+
+			THEN("Different code isn't given the cached bitcode") {
+				compile("int answer() { return 43; }");
+				REQUIRE(countCached() == 2);
+			}
+		}
+
+		WHEN("Code including a header from a joined -I<dir> argument is compiled") {
+			auto includeDir = fs::temp_directory_path() / fs::unique_path();
+			fs::create_directories(includeDir);
+			auto writeHeader = [&](const char* value) {
+				fs::ofstream stream{includeDir / "answer.h"};
+				stream << "#define ANSWER " << value << "\n";
+			};
+
+			auto code = "#include \"answer.h\"\nint answer() { return ANSWER; }";
+
+			writeHeader("42");
+			compileWith({"-I" + includeDir.string()}, code);
+
+			THEN("Changing the header means it's compiled again") {
+				writeHeader("43");
+				compileWith({"-I" + includeDir.string()}, code);
+				REQUIRE(countCached() == 2);
+			}
+
+			fs::remove_all(includeDir);
+		}
+
+		fs::remove_all(cacheDir);
+	}
+}
+
+TEST_CASE("compileCToBitcode keys input files on the headers digest it's given", "") {
+	GIVEN("A C file that includes a header next to it") {
+		auto clangExe = findClang();
+		if (clangExe.empty()) {
+			WARN("clang wasn't found, so C code can't be compiled");
+			return;
+		}
+
+		auto cacheDir = fs::temp_directory_path() / fs::unique_path();
+		auto srcDir   = fs::temp_directory_path() / fs::unique_path();
+		fs::create_directories(srcDir);
+		auto writeHeader = [&](const char* value) {
+			fs::ofstream stream{srcDir / "answer.h"};
+			stream << "#define ANSWER " << value << "\n";
+		};
+		{
+			fs::ofstream stream{srcDir / "answer.c"};
+			stream << "#include \"answer.h\"\nint answer() { return ANSWER; }\n";
+		}
+		writeHeader("42");
+
+		Result res;
+		auto   countCached = [&] {
+			return std::count_if(fs::directory_iterator{cacheDir}, fs::directory_iterator{},
+			                     [](const fs::directory_entry& entry) {
+				                     return entry.path().extension() == ".bc";
+				                 });
+		};
+		auto compile = [&](const std::string& headersDigest) {
+			std::string bitcode;
+			res += compileCToBitcode(clangExe, {(srcDir / "answer.c").string()}, "", &bitcode,
+			                         cacheDir, headersDigest);
+			REQUIRE(!!res);
+			REQUIRE(!bitcode.empty());
+		};
+
+		WHEN("It's compiled with the digest of its directory") {
+			auto digest = hashCHeaders(srcDir);
+			compile(digest);
+			REQUIRE(countCached() == 1);
+
+			THEN("The directory isn't read again for the same digest") {
+				writeHeader("43");
+				compile(digest);
+				REQUIRE(countCached() == 1);
+			}
+
+			THEN("The digest changes with the header, and it's compiled again") {
+				writeHeader("43");
+				REQUIRE(hashCHeaders(srcDir) != digest);
+				compile(hashCHeaders(srcDir));
+				REQUIRE(countCached() == 2);
+			}
+		}
+
+		fs::remove_all(srcDir);
+		fs::remove_all(cacheDir);
+	}
+}
+
+TEST_CASE("compileCToBitcode can run on many threads at once", "") {
+	GIVEN("Eight different functions") {
+		auto clangExe = findClang();
+		if (clangExe.empty()) {
+			WARN("clang wasn't found, so C code can't be compiled");
+			return;
+		}
+
+		std::vector<std::string> codes;
+		for (auto idx = 0; idx < 8; ++idx) {
+			codes.push_back("int answer() { return " + std::to_string(idx) + "; }");
+		}
+
+		WHEN("They are compiled in parallel") {
+			std::vector<std::string> bitcodes(codes.size());
+			std::vector<Result>      results(codes.size());
+			parallelFor(codes.size(), 4, [&](size_t idx) {
+				results[idx] = compileCToBitcode(clangExe, {}, codes[idx], &bitcodes[idx]);
+			});
+
+			THEN("Each one is compiled correctly") {
+				llvm::LLVMContext llctx;
+				for (auto idx = 0ull; idx < codes.size(); ++idx) {
+					REQUIRE(!!results[idx]);
+
+					std::unique_ptr<llvm::Module> mod;
+					REQUIRE(!!parseBitcodeString(bitcodes[idx], llctx, &mod));
+					REQUIRE(mod->getFunction("answer") != nullptr);
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("c-call nodes with the same code share one copy of it", "") {
+	GIVEN("A module with two functions that call the same C code") {
+		if (findClang().empty()) {
+			WARN("clang wasn't found, so C code can't be compiled");
+			return;
+		}
+
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto i32 = c.langModule()->typeFromName("i32");
+
+		auto mod = c.newGraphModule("test/ccall");
+		mod->setCEnabled(true);
+
+		for (auto name : {"first", "second"}) {
+			auto func = mod->getOrCreateFunction(name, {}, {{"out", i32}}, {""}, {""});
+			REQUIRE(func != nullptr);
+
+			std::unique_ptr<NodeType> callType;
+			res += mod->nodeTypeFromName("c-call",
+			                             {{"code", "int answer() { return 42; }"},
+			                              {"function", "answer"},
+			                              {"extraflags", nlohmann::json::array()},
+			                              {"inputs", nlohmann::json::array()},
+			                              {"output", "lang:i32"}},
+			                             &callType);
+			REQUIRE(!!res);
+
+			auto nodes = insertEntryAndExit(*func, res, false);
+
+			NodeInstance* call = nullptr;
+			res += func->insertNode(std::move(callType), 0, 0, boost::uuids::random_generator()(),
+			                        &call);
+			res += connectExec(*nodes.entry, 0, *call, 0);
+			res += connectExec(*call, 0, *nodes.exitNode, 0);
+			res += connectData(*call, 0, *nodes.exitNode, 0);
+			REQUIRE(!!res);
+		}
+
+		WHEN("It is compiled") {
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*mod, CompileSettings::Default, &llmod);
+			REQUIRE(!!res);
+
+			THEN("The C function is defined once and the module is valid") {
+				auto answer = llmod->getFunction("answer");
+				REQUIRE(answer != nullptr);
+				REQUIRE(!answer->isDeclaration());
+				REQUIRE(!llvm::verifyModule(*llmod));
+			}
+
+			THEN("The bookkeeping for which code was linked is removed") {
+				REQUIRE(llmod->getNamedMetadata("chi.linked-c-code") == nullptr);
+			}
+		}
+	}
+}
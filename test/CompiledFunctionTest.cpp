@@ -0,0 +1,86 @@
+#include <catch.hpp>
+#include "TestCommon.hpp"
+
+#include <chi/CompiledFunction.hpp>
+#include <chi/Context.hpp>
+#include <chi/DataType.hpp>
+#include <chi/GraphFunction.hpp>
+#include <chi/GraphModule.hpp>
+#include <chi/LangModule.hpp>
+#include <chi/NameMangler.hpp>
+#include <chi/NodeInstance.hpp>
+#include <chi/Support/Result.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace chi;
+
+TEST_CASE("CompiledFunction", "") {
+	GIVEN("A function that passes its input to its output") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto& langMod = *c.langModule();
+
+		auto mod  = c.newGraphModule("test/compiled");
+		auto func = mod->getOrCreateFunction("identity", {{"in", langMod.typeFromName("i32")}},
+		                                     {{"out", langMod.typeFromName("i32")}}, {""}, {""});
+		REQUIRE(func != nullptr);
+
+		auto nodes = insertEntryAndExit(*func, res);
+		res += connectData(*nodes.entry, 0, *nodes.exitNode, 0);
+		REQUIRE(!!res);
+
+		WHEN("It is compiled") {
+			// no workspace, so don't use the cache
+			std::unique_ptr<CompiledFunction> compiled;
+			res += CompiledFunction::compile(*func, &compiled, llvm::CodeGenOpt::Default,
+			                                 CompileSettings::LinkDependencies);
+			REQUIRE(!!res);
+			REQUIRE(compiled != nullptr);
+
+			THEN("It has the mangled name") {
+				REQUIRE(compiled->mangledName() == mangleFunctionName("test/compiled", "identity"));
+			}
+
+			THEN("It can be called many times") {
+				auto identity = compiled->as<int32_t(int32_t, int32_t, int32_t*)>();
+
+				for (int32_t i = 0; i < 100; ++i) {
+					int32_t out = -1;
+					REQUIRE(identity(0, i, &out) == 0);
+					REQUIRE(out == i);
+				}
+			}
+
+			THEN("It can be run over a batch of records") {
+				std::vector<int32_t> ins(1000), outs(1000, -1), execOuts(1000, -1);
+				for (auto idx = 0ull; idx < ins.size(); ++idx) { ins[idx] = int32_t(idx * 3); }
+
+				void* inputs[]  = {ins.data()};
+				void* outputs[] = {outs.data()};
+				compiled->runBatch(int64_t(ins.size()), 0, inputs, outputs, execOuts.data());
+
+				REQUIRE(outs == ins);
+				REQUIRE(std::all_of(execOuts.begin(), execOuts.end(),
+				                    [](int32_t execOut) { return execOut == 0; }));
+			}
+
+			THEN("A batch that isn't positive doesn't run anything") {
+				int32_t in = 7, out = -1, execOut = -1;
+				void*   inputs[]  = {&in};
+				void*   outputs[] = {&out};
+				compiled->runBatch(0, 0, inputs, outputs, &execOut);
+				compiled->runBatch(-5, 0, inputs, outputs, &execOut);
+
+				REQUIRE(out == -1);
+				REQUIRE(execOut == -1);
+			}
+		}
+	}
+}
@@ -1,12 +1,36 @@
 #include <catch.hpp>
+#include "TestCommon.hpp"
 
+#include <chi/CompiledFunction.hpp>
 #include <chi/Context.hpp>
 #include <chi/DataType.hpp>
+#include <chi/GraphFunction.hpp>
+#include <chi/GraphModule.hpp>
+#include <chi/LLVMVersion.hpp>
 #include <chi/LangModule.hpp>
+#include <chi/NameMangler.hpp>
+#include <chi/NodeInstance.hpp>
 #include <chi/NodeType.hpp>
 #include <chi/Support/Result.hpp>
 
+#if LLVM_VERSION_AT_LEAST(3, 8)
+#include <llvm/IR/DebugInfoMetadata.h>
+#endif
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 using namespace chi;
 namespace fs = boost::filesystem;
@@ -123,3 +147,387 @@ TEST_CASE("Contexts can be created and modules can be added to them", "[Context]
 
 	GIVEN("A context constructed with a workspace") {}
 }
+
+TEST_CASE("Contexts compile diamond dependencies once and detect circular dependencies",
+          "[Context]") {
+	// create a workspace
+	fs::path workspaceDir = boost::filesystem::temp_directory_path() / fs::unique_path();
+	fs::create_directories(workspaceDir);
+	{ fs::ofstream stream{workspaceDir / ".chigraphworkspace"}; }
+
+	Context c{workspaceDir};
+	Result  res;
+
+	// a depends on b and c, which both depend on d. a uses d directly too
+	auto modD = c.newGraphModule("test/d");
+	auto modB = c.newGraphModule("test/b");
+	auto modC = c.newGraphModule("test/c");
+	auto modA = c.newGraphModule("test/a");
+
+	REQUIRE(!!modB->addDependency("test/d"));
+	REQUIRE(!!modC->addDependency("test/d"));
+	REQUIRE(!!modA->addDependency("test/b"));
+	REQUIRE(!!modA->addDependency("test/c"));
+
+	REQUIRE(!!modA->addDependency("test/d"));
+
+	// add a function that goes straight from entry to exit, calling `callee` on the way if it's set
+	auto addFunc = [&](GraphModule& mod, const std::string& name, GraphModule* calleeMod,
+	                   const std::string& callee) {
+		auto newFunc = mod.getOrCreateFunction(name, {}, {}, {""}, {""});
+		REQUIRE(newFunc != nullptr);
+
+		auto nodes = insertEntryAndExit(*newFunc, res, calleeMod == nullptr);
+
+		if (calleeMod != nullptr) {
+			std::unique_ptr<NodeType> callType;
+			res += calleeMod->nodeTypeFromName(callee, {}, &callType);
+			REQUIRE(!!res);
+			NodeInstance* call = nullptr;
+			res += newFunc->insertNode(std::move(callType), 0, 0,
+			                           boost::uuids::random_generator()(), &call);
+			res += connectExec(*nodes.entry, 0, *call, 0);
+			res += connectExec(*call, 0, *nodes.exitNode, 0);
+		}
+		REQUIRE(!!res);
+
+		return newFunc;
+	};
+
+	// a calls dfunc, nothing calls dunused
+	auto func = addFunc(*modD, "dfunc", nullptr, {});
+	addFunc(*modD, "dunused", nullptr, {});
+	addFunc(*modA, "afunc", modD, "dfunc");
+
+	auto checkCompiled = [&](Flags<CompileSettings> settings) {
+		std::unique_ptr<llvm::Module> llmod;
+		res += c.compileModule(*modA, settings, &llmod);
+		REQUIRE(!!res);
+		REQUIRE(llmod != nullptr);
+
+		auto dfunc = llmod->getFunction(mangleFunctionName("test/d", "dfunc"));
+		REQUIRE(dfunc != nullptr);
+		REQUIRE(!dfunc->isDeclaration());
+
+		// only what's used is linked
+		REQUIRE(llmod->getFunction(mangleFunctionName("test/d", "dunused")) == nullptr);
+	};
+
+	THEN("It compiles and links d") { checkCompiled(CompileSettings::LinkDependencies); }
+
+	THEN("It compiles and links d in parallel") {
+		checkCompiled(Flags<CompileSettings>{CompileSettings::LinkDependencies} |
+		              CompileSettings::Parallel);
+	}
+
+	WHEN("b and c both call into d") {
+		addFunc(*modB, "bfunc", modD, "dfunc");
+		addFunc(*modC, "cfunc", modD, "dfunc");
+		addFunc(*modA, "callsb", modB, "bfunc");
+		addFunc(*modA, "callsc", modC, "cfunc");
+
+		// count the definitions of dfunc, including any the linker renamed to avoid a clash
+		auto dfuncDefinitions = [](llvm::Module& llmod) {
+			auto dfuncName = mangleFunctionName("test/d", "dfunc");
+			return std::count_if(llmod.begin(), llmod.end(), [&](const llvm::Function& llfunc) {
+				auto name = llfunc.getName();
+				return !llfunc.isDeclaration() &&
+				       (name == dfuncName || name.startswith(dfuncName + "."));
+			});
+		};
+
+		auto checkLinkedOnce = [&](Flags<CompileSettings> settings) {
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*modA, settings, &llmod);
+			REQUIRE(!!res);
+			REQUIRE(dfuncDefinitions(*llmod) == 1);
+		};
+
+		THEN("d is linked in once") { checkLinkedOnce(CompileSettings::LinkDependencies); }
+
+		THEN("d is linked in once when compiling in parallel") {
+			checkLinkedOnce(Flags<CompileSettings>{CompileSettings::LinkDependencies} |
+			                CompileSettings::Parallel);
+		}
+	}
+
+	THEN("The cache is keyed by content, not by edit time") {
+		auto countCached = [&] {
+			auto dir = workspaceDir / "lib" / "test" / "d";
+			return std::count_if(fs::directory_iterator{dir}, fs::directory_iterator{},
+			                     [](const fs::directory_entry& entry) {
+				                     return entry.path().extension() == ".bc";
+				                 });
+		};
+
+		checkCompiled(CompileSettings::Default);
+		REQUIRE(countCached() == 1);
+
+		// touching the module doesn't change its content
+		modD->updateLastEditTime(modD->lastEditTime() + 10);
+		checkCompiled(CompileSettings::Default);
+		REQUIRE(countCached() == 1);
+
+		// but changing it does
+		func->setDescription("A different description");
+		checkCompiled(CompileSettings::Default);
+		REQUIRE(countCached() == 2);
+	}
+
+	// count the calls from afunc to dfunc
+	auto callsToDFunc = [](llvm::Module& llmod) {
+		auto afunc = llmod.getFunction(mangleFunctionName("test/a", "afunc"));
+		REQUIRE(afunc != nullptr);
+		return std::count_if(
+		    llvm::inst_begin(afunc), llvm::inst_end(afunc), [](const llvm::Instruction& inst) {
+			    auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+			    return call != nullptr && call->getCalledFunction() != nullptr &&
+			           call->getCalledFunction()->getName() ==
+			               mangleFunctionName("test/d", "dfunc");
+			});
+	};
+
+	THEN("Small functions are inlined into their callers") {
+		std::unique_ptr<llvm::Module> llmod;
+		res += c.compileModule(*modA,
+		                       Flags<CompileSettings>{CompileSettings::LinkDependencies} |
+		                           CompileSettings::InlineFunctions,
+		                       &llmod);
+		REQUIRE(!!res);
+
+		REQUIRE(callsToDFunc(*llmod) == 0);
+
+		// the exec ids passed to and returned from the inlined function are folded away
+		auto afunc = llmod->getFunction(mangleFunctionName("test/a", "afunc"));
+		for (const auto& inst : llvm::instructions(*afunc)) {
+			if (auto switchInst = llvm::dyn_cast<llvm::SwitchInst>(&inst)) {
+				REQUIRE_FALSE(llvm::isa<llvm::Constant>(switchInst->getCondition()));
+			}
+		}
+	}
+
+	THEN("Functions that are never inlined are still called") {
+		func->setInlinePolicy(InlinePolicy::Never);
+
+		std::unique_ptr<llvm::Module> llmod;
+		res += c.compileModule(*modA,
+		                       Flags<CompileSettings>{CompileSettings::LinkDependencies} |
+		                           CompileSettings::InlineFunctions,
+		                       &llmod);
+		REQUIRE(!!res);
+
+		REQUIRE(callsToDFunc(*llmod) == 1);
+	}
+
+	THEN("Without InlineFunctions, functions aren't marked for the inliner") {
+		func->setInlinePolicy(InlinePolicy::Always);
+
+		std::unique_ptr<llvm::Module> llmod;
+		res += c.compileModule(*modA, CompileSettings::LinkDependencies, &llmod);
+		REQUIRE(!!res);
+
+		auto dfunc = llmod->getFunction(mangleFunctionName("test/d", "dfunc"));
+		REQUIRE(dfunc != nullptr);
+		REQUIRE_FALSE(dfunc->hasFnAttribute(llvm::Attribute::AlwaysInline));
+		REQUIRE_FALSE(dfunc->hasFnAttribute(llvm::Attribute::NoInline));
+		REQUIRE(callsToDFunc(*llmod) == 1);
+	}
+
+	THEN("Whole program mode only exports the functions in the module itself") {
+		std::unique_ptr<llvm::Module> llmod;
+		res += c.compileModule(*modA,
+		                       Flags<CompileSettings>{CompileSettings::LinkDependencies} |
+		                           CompileSettings::WholeProgram,
+		                       &llmod);
+		REQUIRE(!!res);
+
+		auto afunc = llmod->getFunction(mangleFunctionName("test/a", "afunc"));
+		REQUIRE(afunc != nullptr);
+		REQUIRE(afunc->hasExternalLinkage());
+
+		auto dfunc = llmod->getFunction(mangleFunctionName("test/d", "dfunc"));
+		REQUIRE(dfunc != nullptr);
+		REQUIRE(dfunc->hasInternalLinkage());
+		REQUIRE(dfunc->getCallingConv() == llvm::CallingConv::Fast);
+
+		// the call has to use the same calling convention
+		REQUIRE(callsToDFunc(*llmod) == 1);
+		for (auto user : dfunc->users()) {
+			REQUIRE(llvm::cast<llvm::CallInst>(user)->getCallingConv() == llvm::CallingConv::Fast);
+		}
+	}
+
+	THEN("Modules that nothing calls into aren't generated") {
+		addFunc(*modB, "bunused", nullptr, {});
+
+		checkCompiled(CompileSettings::Default);
+		REQUIRE(fs::exists(workspaceDir / "lib" / "test" / "d"));
+		REQUIRE_FALSE(fs::exists(workspaceDir / "lib" / "test" / "b"));
+	}
+
+	WHEN("d depends on a") {
+		REQUIRE(!!modD->addDependency("test/a"));
+
+		THEN("Compiling reports the cycle instead of recursing forever") {
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*modA, CompileSettings::LinkDependencies, &llmod);
+			REQUIRE(!res);
+			REQUIRE(res.result_json[0]["overview"] == "Circular module dependency");
+		}
+	}
+
+	fs::remove_all(workspaceDir);
+}
+
+TEST_CASE("Whole program mode returns outputs by value from functions in dependencies",
+          "[Context]") {
+	GIVEN("A function that calls a function in another module to double its input") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto i32 = c.langModule()->typeFromName("i32");
+
+		// make a function that takes `in` and outputs `out`, with `body` between entry and exit
+		auto makeFunc = [&](GraphModule& mod, const char* name,
+		                    const std::function<NodeInstance*(GraphFunction&)>& makeBody) {
+			auto func = mod.getOrCreateFunction(name, {{"in", i32}}, {{"out", i32}}, {""}, {""});
+			REQUIRE(func != nullptr);
+
+			auto nodes = insertEntryAndExit(*func, res, false);
+
+			auto body = makeBody(*func);
+			REQUIRE(body != nullptr);
+			res += connectData(*nodes.entry, 0, *body, 0);
+			res += connectData(*body, 0, *nodes.exitNode, 0);
+			if (body->type().pure()) {
+				res += connectExec(*nodes.entry, 0, *nodes.exitNode, 0);
+			} else {
+				res += connectExec(*nodes.entry, 0, *body, 0);
+				res += connectExec(*body, 0, *nodes.exitNode, 0);
+			}
+			REQUIRE(!!res);
+
+			return func;
+		};
+
+		auto depMod = c.newGraphModule("test/dep");
+		makeFunc(*depMod, "twice", [&](GraphFunction& func) {
+			NodeInstance* add = nullptr;
+			res += func.insertNode("lang", "i32+i32", {}, 0, 0, boost::uuids::random_generator()(),
+			                       &add);
+			REQUIRE(!!res);
+			res += connectData(*func.entryNode(), 0, *add, 1);
+			return add;
+		});
+
+		auto mod = c.newGraphModule("test/compiled");
+		REQUIRE(!!mod->addDependency("test/dep"));
+		auto func = makeFunc(*mod, "callstwice", [&](GraphFunction& func) {
+			NodeInstance* call = nullptr;
+			res += func.insertNode("test/dep", "twice", {}, 0, 0,
+			                       boost::uuids::random_generator()(), &call);
+			return call;
+		});
+
+		WHEN("It is compiled as a whole program") {
+			Flags<CompileSettings> settings =
+			    Flags<CompileSettings>{CompileSettings::LinkDependencies} |
+			    CompileSettings::WholeProgram;
+
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*mod, settings, &llmod);
+			REQUIRE(!!res);
+
+			THEN("The function in the dependency returns its output instead of taking a pointer") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/dep", "twice"));
+				REQUIRE(llfunc != nullptr);
+				REQUIRE(llfunc->arg_size() == 2);
+				REQUIRE(llfunc->getReturnType()->isStructTy());
+
+				REQUIRE_FALSE(llvm::verifyModule(*llmod, &llvm::errs()));
+			}
+
+#if LLVM_VERSION_AT_LEAST(3, 8)
+			THEN("Its debug info describes the new signature") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/dep", "twice"));
+				REQUIRE(llfunc->getSubprogram() != nullptr);
+
+				auto types = llfunc->getSubprogram()->getType()->getTypeArray();
+				REQUIRE(types.size() == llfunc->arg_size() + 1);
+				REQUIRE(llvm::isa<llvm::DICompositeType>(types[0]));
+			}
+#endif
+
+			THEN("Compiling it again gives the functions in the same order") {
+				std::unique_ptr<llvm::Module> again;
+				res += c.compileModule(*mod, settings, &again);
+				REQUIRE(!!res);
+
+				auto functionNames = [](const llvm::Module& llmod) {
+					std::vector<std::string> names;
+					for (const auto& llfunc : llmod) { names.push_back(llfunc.getName().str()); }
+					return names;
+				};
+				REQUIRE(functionNames(*llmod) == functionNames(*again));
+			}
+
+			THEN("The function in the module keeps its signature") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/compiled", "callstwice"));
+				REQUIRE(llfunc != nullptr);
+				REQUIRE(llfunc->getFunctionType() == func->functionType());
+			}
+
+			THEN("It still runs correctly") {
+				std::unique_ptr<CompiledFunction> compiled;
+				res +=
+				    CompiledFunction::compile(*func, &compiled, llvm::CodeGenOpt::None, settings);
+				REQUIRE(!!res);
+
+				int32_t out = -1;
+				REQUIRE(compiled->as<int32_t(int32_t, int32_t, int32_t*)>()(0, 21, &out) == 0);
+				REQUIRE(out == 42);
+			}
+		}
+	}
+}
+
+TEST_CASE("Modules can be run lazily", "[Context]") {
+	GIVEN("A module with a main that calls another function") {
+		llvm::LLVMContext llctx;
+		auto              llmod = std::make_unique<llvm::Module>("lazy", llctx);
+
+		auto i32Ty    = llvm::Type::getInt32Ty(llctx);
+		auto answer   = llvm::Function::Create(llvm::FunctionType::get(i32Ty, false),
+		                                       llvm::GlobalValue::InternalLinkage, "answer",
+		                                       llmod.get());
+		auto mainFunc = llvm::Function::Create(llvm::FunctionType::get(i32Ty, false),
+		                                       llvm::GlobalValue::ExternalLinkage, "main",
+		                                       llmod.get());
+
+		llvm::IRBuilder<> builder{llvm::BasicBlock::Create(llctx, "entry", answer)};
+		builder.CreateRet(builder.getInt32(42));
+		builder.SetInsertPoint(llvm::BasicBlock::Create(llctx, "entry", mainFunc));
+		builder.CreateRet(builder.CreateCall(answer, {}));
+
+		WHEN("It's run lazily") {
+			int  ret = -1;
+			auto res = interpretLLVMIRAsMainLazily(std::move(llmod), llvm::CodeGenOpt::None, {},
+			                                       nullptr, &ret);
+
+#if LLVM_VERSION_AT_LEAST(5, 0)
+			THEN("It returns what main returns") {
+				REQUIRE(!!res);
+				REQUIRE(ret == 42);
+			}
+#else
+			THEN("It fails, as the lazy JIT needs LLVM 5.0") {
+				REQUIRE(!res);
+				REQUIRE(ret == -1);
+			}
+#endif
+		}
+	}
+}
@@ -0,0 +1,294 @@
+#include <catch.hpp>
+#include "TestCommon.hpp"
+
+#include <chi/CompiledFunction.hpp>
+#include <chi/Context.hpp>
+#include <chi/DataType.hpp>
+#include <chi/GraphFunction.hpp>
+#include <chi/GraphModule.hpp>
+#include <chi/LangModule.hpp>
+#include <chi/NameMangler.hpp>
+#include <chi/NodeInstance.hpp>
+#include <chi/Support/Result.hpp>
+
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+#include <cstdint>
+
+using namespace chi;
+
+TEST_CASE("Functions can be compiled with their node outputs in registers", "") {
+	GIVEN("A function that passes its input to its output") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto i32 = c.langModule()->typeFromName("i32");
+
+		auto mod  = c.newGraphModule("test/compiled");
+		auto func = mod->getOrCreateFunction("identity", {{"in", i32}}, {{"out", i32}}, {""}, {""});
+		REQUIRE(func != nullptr);
+
+		auto nodes = insertEntryAndExit(*func, res);
+		res += connectData(*nodes.entry, 0, *nodes.exitNode, 0);
+		REQUIRE(!!res);
+
+		WHEN("It is compiled with SSA outputs") {
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*mod, CompileSettings::SSAOutputs, &llmod);
+			REQUIRE(!!res);
+
+			THEN("The node outputs aren't on the stack") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/compiled", "identity"));
+				REQUIRE(llfunc != nullptr);
+				auto outputName = nodes.entry->stringId() + "__0";
+				for (const auto& inst : llvm::instructions(*llfunc)) {
+					if (!llvm::isa<llvm::AllocaInst>(inst)) { continue; }
+					REQUIRE(inst.getName() != outputName);
+				}
+			}
+
+			THEN("It still runs correctly") {
+				std::unique_ptr<CompiledFunction> compiled;
+				res += CompiledFunction::compile(*func, &compiled, llvm::CodeGenOpt::None,
+				                                 CompileSettings::SSAOutputs);
+				REQUIRE(!!res);
+
+				int32_t out = -1;
+				REQUIRE(compiled->as<int32_t(int32_t, int32_t, int32_t*)>()(0, 42, &out) == 0);
+				REQUIRE(out == 42);
+			}
+		}
+	}
+}
+
+TEST_CASE("Functions reuse pures only while their inputs are unchanged", "") {
+	GIVEN("A function that sets a local variable twice, and outputs pures from before and after") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto& langMod = *c.langModule();
+		auto  i32     = langMod.typeFromName("i32");
+
+		auto mod  = c.newGraphModule("test/compiled");
+		auto func = mod->getOrCreateFunction("locals", {{"in", i32}},
+		                                     {{"doubled", i32}, {"quadrupled", i32}}, {""}, {""});
+		REQUIRE(func != nullptr);
+		func->getOrCreateLocalVariable("var", i32);
+
+		auto nodes    = insertEntryAndExit(*func, res, false);
+		auto entry    = nodes.entry;
+		auto exitNode = nodes.exitNode;
+
+		auto insert = [&](const char* modName, const char* typeName, const nlohmann::json& data) {
+			NodeInstance* inst = nullptr;
+			res += func->insertNode(modName, typeName, data, 0, 0,
+			                        boost::uuids::random_generator()(), &inst);
+			return inst;
+		};
+
+		// doubled = in + in, var = doubled
+		auto doubled  = insert("lang", "i32+i32", {});
+		auto firstSet = insert("test/compiled", "_set_var", "lang:i32");
+		// var = var + in, then quadrupled = var + in, which has to read the new var
+		auto get       = insert("test/compiled", "_get_var", "lang:i32");
+		auto sum       = insert("lang", "i32+i32", {});
+		auto secondSet = insert("test/compiled", "_set_var", "lang:i32");
+		REQUIRE(!!res);
+
+		res += connectData(*entry, 0, *doubled, 0);
+		res += connectData(*entry, 0, *doubled, 1);
+		res += connectData(*doubled, 0, *firstSet, 0);
+		res += connectData(*get, 0, *sum, 0);
+		res += connectData(*entry, 0, *sum, 1);
+		res += connectData(*sum, 0, *secondSet, 0);
+		res += connectData(*doubled, 0, *exitNode, 0);
+		res += connectData(*sum, 0, *exitNode, 1);
+
+		res += connectExec(*entry, 0, *firstSet, 0);
+		res += connectExec(*firstSet, 0, *secondSet, 0);
+		res += connectExec(*secondSet, 0, *exitNode, 0);
+		REQUIRE(!!res);
+
+		WHEN("It is compiled and run") {
+			std::unique_ptr<CompiledFunction> compiled;
+			res += CompiledFunction::compile(*func, &compiled, llvm::CodeGenOpt::None);
+			REQUIRE(!!res);
+
+			int32_t doubledOut = -1, quadrupledOut = -1;
+			compiled->as<int32_t(int32_t, int32_t, int32_t*, int32_t*)>()(0, 5, &doubledOut,
+			                                                              &quadrupledOut);
+
+			THEN("The values read after the variable was set are computed again") {
+				REQUIRE(doubledOut == 10);
+				REQUIRE(quadrupledOut == 20);
+			}
+		}
+	}
+}
+
+TEST_CASE("Functions with deep diamonds of pures can be compiled", "") {
+	GIVEN("A function that doubles its input 30 times, each time adding the last value to itself") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto i32 = c.langModule()->typeFromName("i32");
+
+		auto mod  = c.newGraphModule("test/compiled");
+		auto func = mod->getOrCreateFunction("doubling", {{"in", i32}}, {{"out", i32}}, {""}, {""});
+		REQUIRE(func != nullptr);
+
+		auto nodes    = insertEntryAndExit(*func, res);
+		auto entry    = nodes.entry;
+		auto exitNode = nodes.exitNode;
+
+		// every add depends on the last one twice, so without removing duplicates this would
+		// generate 2^30 adds
+		auto last = entry;
+		for (auto idx = 0; idx < 30; ++idx) {
+			NodeInstance* add = nullptr;
+			res += func->insertNode("lang", "i32+i32", {}, 0, 0, boost::uuids::random_generator()(),
+			                        &add);
+			REQUIRE(!!res);
+			res += connectData(*last, 0, *add, 0);
+			res += connectData(*last, 0, *add, 1);
+			last = add;
+		}
+		res += connectData(*last, 0, *exitNode, 0);
+		REQUIRE(!!res);
+
+		WHEN("It is compiled and run") {
+			std::unique_ptr<CompiledFunction> compiled;
+			res += CompiledFunction::compile(*func, &compiled, llvm::CodeGenOpt::None);
+			REQUIRE(!!res);
+
+			int32_t out = -1;
+			compiled->as<int32_t(int32_t, int32_t, int32_t*)>()(0, 1, &out);
+
+			THEN("It doubles it 30 times") { REQUIRE(out == int32_t(1) << 30); }
+		}
+	}
+}
+
+TEST_CASE("Functions fold constants", "") {
+	GIVEN("A function that outputs 6 * 7") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto mod  = c.newGraphModule("test/compiled");
+		auto func = mod->getOrCreateFunction("answer", {},
+		                                     {{"out", c.langModule()->typeFromName("i32")}}, {""},
+		                                     {""});
+		REQUIRE(func != nullptr);
+
+		auto nodes = insertEntryAndExit(*func, res);
+
+		NodeInstance *six = nullptr, *seven = nullptr, *mul = nullptr;
+		res += func->insertNode("lang", "const-int", 6, 0, 0, boost::uuids::random_generator()(),
+		                        &six);
+		res += func->insertNode("lang", "const-int", 7, 0, 0, boost::uuids::random_generator()(),
+		                        &seven);
+		res += func->insertNode("lang", "i32*i32", {}, 0, 0, boost::uuids::random_generator()(),
+		                        &mul);
+		REQUIRE(!!res);
+		res += connectData(*six, 0, *mul, 0);
+		res += connectData(*seven, 0, *mul, 1);
+		res += connectData(*mul, 0, *nodes.exitNode, 0);
+		REQUIRE(!!res);
+
+		WHEN("It is compiled with FoldConstants") {
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*mod, CompileSettings::FoldConstants, &llmod);
+			REQUIRE(!!res);
+
+			THEN("There is no multiply left, just the answer") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/compiled", "answer"));
+				REQUIRE(llfunc != nullptr);
+				for (const auto& inst : llvm::instructions(*llfunc)) {
+					REQUIRE(inst.getOpcode() != llvm::Instruction::Mul);
+				}
+			}
+
+			THEN("Nothing generated while folding is left behind") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/compiled", "answer"));
+				REQUIRE(llfunc != nullptr);
+				for (const auto& block : *llfunc) {
+					REQUIRE_FALSE(block.getName().startswith("fold"));
+				}
+			}
+
+			THEN("It still runs correctly") {
+				std::unique_ptr<CompiledFunction> compiled;
+				res += CompiledFunction::compile(*func, &compiled, llvm::CodeGenOpt::None,
+				                                 CompileSettings::FoldConstants);
+				REQUIRE(!!res);
+
+				int32_t out = -1;
+				REQUIRE(compiled->as<int32_t(int32_t, int32_t*)>()(0, &out) == 0);
+				REQUIRE(out == 42);
+			}
+		}
+	}
+
+	GIVEN("A function that outputs 42 / 0") {
+		Context c;
+		Result  res;
+
+		res += c.loadModule("lang");
+		REQUIRE(!!res);
+
+		auto mod  = c.newGraphModule("test/compiled");
+		auto func = mod->getOrCreateFunction("divbyzero", {},
+		                                     {{"out", c.langModule()->typeFromName("i32")}}, {""},
+		                                     {""});
+		REQUIRE(func != nullptr);
+
+		auto nodes = insertEntryAndExit(*func, res);
+
+		NodeInstance *answer = nullptr, *zero = nullptr, *div = nullptr;
+		res += func->insertNode("lang", "const-int", 42, 0, 0, boost::uuids::random_generator()(),
+		                        &answer);
+		res += func->insertNode("lang", "const-int", 0, 0, 0, boost::uuids::random_generator()(),
+		                        &zero);
+		res += func->insertNode("lang", "i32/i32", {}, 0, 0, boost::uuids::random_generator()(),
+		                        &div);
+		REQUIRE(!!res);
+		res += connectData(*answer, 0, *div, 0);
+		res += connectData(*zero, 0, *div, 1);
+		res += connectData(*div, 0, *nodes.exitNode, 0);
+		REQUIRE(!!res);
+
+		WHEN("It is compiled with FoldConstants") {
+			std::unique_ptr<llvm::Module> llmod;
+			res += c.compileModule(*mod, CompileSettings::FoldConstants, &llmod);
+			REQUIRE(!!res);
+
+			THEN("The division isn't folded away, and nothing is undef") {
+				auto llfunc = llmod->getFunction(mangleFunctionName("test/compiled", "divbyzero"));
+				REQUIRE(llfunc != nullptr);
+
+				auto hasDivide = false;
+				for (const auto& inst : llvm::instructions(*llfunc)) {
+					if (inst.getOpcode() == llvm::Instruction::SDiv) { hasDivide = true; }
+					for (const auto& operand : inst.operands()) {
+						REQUIRE_FALSE(llvm::isa<llvm::UndefValue>(operand.get()));
+					}
+				}
+				REQUIRE(hasDivide);
+			}
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#include <catch.hpp>
+
+#include <chi/JITObjectCache.hpp>
+#include <chi/LLVMVersion.hpp>
+
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <boost/filesystem.hpp>
+
+#include <memory>
+
+namespace fs = boost::filesystem;
+
+using namespace chi;
+
+TEST_CASE("JITObjectCache", "") {
+	GIVEN("An empty cache and a module") {
+		auto cacheDir = fs::temp_directory_path() / fs::unique_path();
+
+		llvm::LLVMContext llctx;
+		llvm::Module      mod{"main", llctx};
+
+		JITObjectCache cache{cacheDir};
+
+		THEN("Nothing is cached for it") { REQUIRE(cache.getObject(&mod) == nullptr); }
+
+		THEN("Its key changes when the module changes") {
+			auto cachePath = cache.cachePathForModule(mod);
+
+			llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(llctx), false),
+			                       llvm::GlobalValue::ExternalLinkage, "added", &mod);
+			REQUIRE(cache.cachePathForModule(mod) != cachePath);
+		}
+
+		WHEN("A key is given for it before it changes") {
+			auto key = cache.cacheKeyForModule(mod);
+			cache.setKey(mod, key);
+
+			llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(llctx), false),
+			                       llvm::GlobalValue::ExternalLinkage, "added", &mod);
+
+			THEN("That key is used") {
+				REQUIRE(cache.cachePathForModule(mod) == cacheDir / (key + ".o"));
+			}
+
+			THEN("The key is forgotten once the object is stored") {
+				auto obj = llvm::MemoryBuffer::getMemBuffer("an object", "", false);
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+				cache.notifyObjectCompiled(&mod, obj);
+				delete obj;
+#else
+				cache.notifyObjectCompiled(&mod, obj->getMemBufferRef());
+#endif
+				REQUIRE(fs::is_regular_file(cacheDir / (key + ".o")));
+				REQUIRE(cache.cachePathForModule(mod) != cacheDir / (key + ".o"));
+				REQUIRE(cache.getObject(&mod) == nullptr);
+			}
+		}
+
+		WHEN("An object is stored for it") {
+			std::string objData = "not really an object";
+			auto        obj     = llvm::MemoryBuffer::getMemBuffer(objData, "", false);
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+			cache.notifyObjectCompiled(&mod, obj);
+			delete obj;
+#else
+			cache.notifyObjectCompiled(&mod, obj->getMemBufferRef());
+#endif
+
+			THEN("It is stored in the cache directory") {
+				REQUIRE(fs::is_regular_file(cache.cachePathForModule(mod)));
+				REQUIRE(cache.cachePathForModule(mod).parent_path() == cacheDir);
+			}
+
+			THEN("It can be retrieved") {
+				auto fetched = cache.getObject(&mod);
+				REQUIRE(fetched != nullptr);
+				REQUIRE(fetched->getBuffer().str() == objData);
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+				delete fetched;
+#endif
+			}
+
+			THEN("A different module doesn't get it") {
+				llvm::Module otherMod{"other", llctx};
+				REQUIRE(cache.getObject(&otherMod) == nullptr);
+			}
+
+			THEN("A module that is allocated after it's gone doesn't get it") {
+				auto heapMod = std::make_unique<llvm::Module>("heap", llctx);
+				auto heapObj = llvm::MemoryBuffer::getMemBuffer(objData, "", false);
+#if LLVM_VERSION_LESS_EQUAL(3, 5)
+				cache.notifyObjectCompiled(heapMod.get(), heapObj);
+				delete heapObj;
+#else
+				cache.notifyObjectCompiled(heapMod.get(), heapObj->getMemBufferRef());
+#endif
+				heapMod.reset();
+
+				// this may well be at the same address as the old one
+				heapMod = std::make_unique<llvm::Module>("reused", llctx);
+				REQUIRE(cache.getObject(heapMod.get()) == nullptr);
+			}
+
+			THEN("A cache with a different optimization level doesn't get it") {
+				JITObjectCache aggressiveCache{cacheDir, llvm::CodeGenOpt::Aggressive};
+				REQUIRE(aggressiveCache.getObject(&mod) == nullptr);
+			}
+		}
+
+		fs::remove_all(cacheDir);
+	}
+}
@@ -0,0 +1,71 @@
+#include <catch.hpp>
+
+#include <chi/Support/ParallelFor.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CASE("ParallelFor", "") {
+	GIVEN("A vector of slots") {
+		std::vector<int> slots(100, 0);
+
+		WHEN("We run it on one job") {
+			chi::parallelFor(slots.size(), 1, [&](size_t idx) { slots[idx] += int(idx); });
+
+			THEN("Every slot is visited once") {
+				for (auto idx = 0ull; idx < slots.size(); ++idx) {
+					REQUIRE(slots[idx] == int(idx));
+				}
+			}
+		}
+
+		WHEN("We run it on many jobs") {
+			std::atomic<int> visits{0};
+			chi::parallelFor(slots.size(), 8, [&](size_t idx) {
+				slots[idx] += int(idx);
+				++visits;
+			});
+
+			THEN("Every slot is visited once") {
+				REQUIRE(visits == int(slots.size()));
+				for (auto idx = 0ull; idx < slots.size(); ++idx) {
+					REQUIRE(slots[idx] == int(idx));
+				}
+			}
+		}
+
+		WHEN("It's run inside another parallelFor") {
+			std::vector<std::thread::id> outerThreads(4), innerThreads(slots.size());
+			chi::parallelFor(outerThreads.size(), 4, [&](size_t outerIdx) {
+				outerThreads[outerIdx] = std::this_thread::get_id();
+				if (outerIdx != 0) { return; }
+
+				chi::parallelFor(slots.size(), 8, [&](size_t idx) {
+					slots[idx] += int(idx);
+					innerThreads[idx] = std::this_thread::get_id();
+				});
+			});
+
+			THEN("The inner loop runs in order on the thread that called it") {
+				for (auto idx = 0ull; idx < slots.size(); ++idx) {
+					REQUIRE(slots[idx] == int(idx));
+					REQUIRE(innerThreads[idx] == outerThreads[0]);
+				}
+			}
+		}
+
+		WHEN("There are more jobs than slots") {
+			chi::parallelFor(3, 16, [&](size_t idx) { slots[idx] = 1; });
+
+			THEN("Only those slots are visited") {
+				REQUIRE(slots[0] == 1);
+				REQUIRE(slots[1] == 1);
+				REQUIRE(slots[2] == 1);
+				REQUIRE(slots[3] == 0);
+			}
+		}
+	}
+
+	REQUIRE(chi::defaultJobCount() >= 1);
+}
@@ -1,10 +1,44 @@
+#pragma once
+
 #include <catch.hpp>
 
 #include <chi/DataType.hpp>
+#include <chi/GraphFunction.hpp>
+#include <chi/NodeInstance.hpp>
+#include <chi/NodeType.hpp>
+#include <chi/Support/Result.hpp>
+
+#include <boost/uuid/uuid_generators.hpp>
+
+#include <memory>
 
 namespace Catch {
-std::string toString(const chi::DataType& ty) { return ty.qualifiedName(); }
-std::string toString(const chi::NamedDataType& ty) {
+inline std::string toString(const chi::DataType& ty) { return ty.qualifiedName(); }
+inline std::string toString(const chi::NamedDataType& ty) {
 	return "{" + ty.name + ", " + ty.type.qualifiedName() + "}";
 }
 }
+
+// The nodes insertEntryAndExit adds
+struct EntryAndExit {
+	chi::NodeInstance* entry    = nullptr;
+	chi::NodeInstance* exitNode = nullptr;
+};
+
+// Insert an entry and an exit node into `func`, adding any errors to `res`. If `connect` is set,
+// the entry goes straight to the exit, otherwise something has to be put between them
+inline EntryAndExit insertEntryAndExit(chi::GraphFunction& func, chi::Result& res,
+                                       bool connect = true) {
+	EntryAndExit nodes;
+	res += func.getOrInsertEntryNode(0, 0, boost::uuids::random_generator()(), &nodes.entry);
+
+	std::unique_ptr<chi::NodeType> exitType;
+	res += func.createExitNodeType(&exitType);
+	res += func.insertNode(std::move(exitType), 0, 0, boost::uuids::random_generator()(),
+	                       &nodes.exitNode);
+
+	if (connect && res) { res += chi::connectExec(*nodes.entry, 0, *nodes.exitNode, 0); }
+	REQUIRE(!!res);
+
+	return nodes;
+}
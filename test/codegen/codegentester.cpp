@@ -1,6 +1,7 @@
 #include <chi/Context.hpp>
 #include <chi/GraphModule.hpp>
 #include <chi/JsonSerializer.hpp>
+#include <chi/LLVMVersion.hpp>
 #include <chi/Support/Result.hpp>
 #include <chi/Support/Subprocess.hpp>
 #include <chi/Support/LibCLocator.hpp>
@@ -312,15 +313,23 @@ int main(int argc, char** argv) {
 		std::cout << "Suceeded." << std::endl;
 	}
 
-	std::cout << "Testing with chi run...";
-	std::cout.flush();
+	// chi run, and chi run --lazy where the lazy JIT is supported
+	std::vector<std::vector<std::string>> runArgs{{"run", "main.chimod"}};
+#if LLVM_VERSION_AT_LEAST(5, 0)
+	runArgs.push_back({"run", "--lazy", "main.chimod"});
+#endif
+	for (const auto& args : runArgs) {
+		// the arguments without the module
+		std::string name = "chi";
+		for (auto iter = args.begin(); iter != args.end() - 1; ++iter) { name += " " + *iter; }
+
+		std::cout << "Testing with " << name << "...";
+		std::cout.flush();
 
-	// chi run
-	{
 		std::string generatedstdout, generatedstderr;
 		{
 			Subprocess chiexe{chiExePath};
-			chiexe.setArguments({"run", "main.chimod"});
+			chiexe.setArguments(args);
 			chiexe.attachToStdErr([&generatedstderr](const char* data, size_t size) {
 				generatedstderr.append(data, size);
 			});
@@ -337,8 +346,8 @@ int main(int argc, char** argv) {
 			int retcode = chiexe.exitCode();
 
 			if (retcode != expectedreturncode) {
-				std::cerr << "(chi run) Unexpected retcode: " << retcode << " expected was "
-				          << expectedreturncode << std::endl
+				std::cerr << "(" << name << ") Unexpected retcode: " << retcode
+				          << " expected was " << expectedreturncode << std::endl
 				          << "stdout: \"" << generatedstdout << "\"" << std::endl
 				          << "stderr: \"" << generatedstderr << "\"" << std::endl;
 
@@ -346,7 +355,7 @@ int main(int argc, char** argv) {
 			}
 
 			if (generatedstdout != expectedcout) {
-				std::cerr << "(chi run) Unexpected stdout: \"" << generatedstdout
+				std::cerr << "(" << name << ") Unexpected stdout: \"" << generatedstdout
 				          << "\" expected was \"" << expectedcout << '\"' << std::endl
 				          << "retcode: \"" << retcode << "\"" << std::endl
 				          << "stderr: \"" << generatedstderr << "\"" << std::endl;
@@ -355,7 +364,7 @@ int main(int argc, char** argv) {
 			}
 
 			if (generatedstderr != expectedcerr) {
-				std::cerr << "(chi run) Unexpected stderr: \"" << generatedstderr
+				std::cerr << "(" << name << ") Unexpected stderr: \"" << generatedstderr
 				          << "\" expected was \"" << expectedcerr << '\"' << std::endl
 				          << "retcode: \"" << retcode << "\"" << std::endl
 				          << "stdout: \"" << generatedstdout << "\"" << std::endl;